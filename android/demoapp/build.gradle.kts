@@ -37,6 +37,10 @@ android {
     buildFeatures {
         compose = true
     }
+    androidResources {
+        // Models are read in place from the APK by FaceMatchSdkImpl.init
+        noCompress += "onnx"
+    }
 }
 
 dependencies {
@@ -1,5 +1,7 @@
 #include <jni.h>
 #include <string>
+#include <algorithm>
+#include <map>
 #include "FMCore.h"
 #include <android/log.h>
 #include <stdio.h>
@@ -9,8 +11,71 @@
 
 static FMCore engine;
 
+// JNI lookups resolved once in JNI_OnLoad
+static jclass g_processResultClass = nullptr;
+static jmethodID g_processResultCtor = nullptr;
+
+// Layout of the direct FloatBuffer filled by the zero-copy process calls,
+// mirrored by the RESULT_* constants in NativeBridge.kt
+enum ResultLayout {
+    RESULT_LIVENESS_CHECKED = 0,
+    RESULT_IS_LIVE = 1,
+    RESULT_FACE_DETECTED = 2,
+    RESULT_EMBEDDING_EXTRACTED = 3,
+    RESULT_LIVENESS_SCORE = 4,
+    RESULT_EMBEDDING_SIZE = 5,
+    RESULT_HEADER_SIZE = 6
+};
+
+// Writes the result into the caller-owned buffer, returns the number of floats written or -1
+static jint writeResult(JNIEnv* env, const ProcessResult& result, jobject resultBuffer) {
+    float* out = static_cast<float*>(env->GetDirectBufferAddress(resultBuffer));
+    jlong capacity = env->GetDirectBufferCapacity(resultBuffer);
+    jlong needed = RESULT_HEADER_SIZE + static_cast<jlong>(result.embedding.size());
+    if (out == nullptr || capacity < needed) {
+        std::cerr << "[JNI] Result buffer is not direct or too small (" << capacity << " < " << needed << ")" << std::endl;
+        return -1;
+    }
+
+    out[RESULT_LIVENESS_CHECKED] = result.livenessChecked ? 1.0f : 0.0f;
+    out[RESULT_IS_LIVE] = result.isLive ? 1.0f : 0.0f;
+    out[RESULT_FACE_DETECTED] = result.faceDetected ? 1.0f : 0.0f;
+    out[RESULT_EMBEDDING_EXTRACTED] = result.embeddingExtracted ? 1.0f : 0.0f;
+    out[RESULT_LIVENESS_SCORE] = result.livenessScore;
+    out[RESULT_EMBEDDING_SIZE] = static_cast<float>(result.embedding.size());
+    std::copy(result.embedding.begin(), result.embedding.end(), out + RESULT_HEADER_SIZE);
+    return static_cast<jint>(needed);
+}
+
+static const uint8_t* directAddress(JNIEnv* env, jobject buffer) {
+    return buffer ? static_cast<const uint8_t*>(env->GetDirectBufferAddress(buffer)) : nullptr;
+}
+
 extern "C" {
 
+JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* /* reserved */) {
+    JNIEnv* env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+
+    jclass localClass = env->FindClass("kl/open/fmandroid/ProcessResult");
+    if (localClass == nullptr) {
+        std::cerr << "[JNI] Failed to find ProcessResult class" << std::endl;
+        return JNI_ERR;
+    }
+    g_processResultClass = static_cast<jclass>(env->NewGlobalRef(localClass));
+    env->DeleteLocalRef(localClass);
+
+    g_processResultCtor = env->GetMethodID(g_processResultClass, "<init>", "(ZZZZ[F)V");
+    if (g_processResultCtor == nullptr) {
+        std::cerr << "[JNI] Failed to find ProcessResult constructor" << std::endl;
+        return JNI_ERR;
+    }
+
+    return JNI_VERSION_1_6;
+}
+
 void redirectStdoutToLogcat() {
     static const char* tag = "NativeSTDOUT";
 
@@ -60,6 +125,45 @@ Java_kl_open_fmandroid_NativeBridge_jni_1init(JNIEnv* env, jobject /* this */, j
     return result;
 }
 
+// public native boolean jni_initWithModels(String configJson, String[] names, int[] fds, long[] offsets, long[] lengths);
+// Models are byte ranges of open files (uncompressed APK assets), mapped in place instead of copied to disk.
+// FMCore duplicates the descriptors, the caller can close its AssetFileDescriptors afterwards.
+JNIEXPORT jboolean JNICALL
+Java_kl_open_fmandroid_NativeBridge_jni_1initWithModels(JNIEnv* env, jobject /* this */, jstring configJson,
+                                                       jobjectArray names, jintArray fds, jlongArray offsets,
+                                                       jlongArray lengths) {
+
+    redirectStdoutToLogcat();
+
+    const jsize count = env->GetArrayLength(names);
+    if (env->GetArrayLength(fds) != count || env->GetArrayLength(offsets) != count ||
+        env->GetArrayLength(lengths) != count) {
+        std::cerr << "[JNI] Model arrays have different sizes" << std::endl;
+        return false;
+    }
+
+    jint* fdValues = env->GetIntArrayElements(fds, nullptr);
+    jlong* offsetValues = env->GetLongArrayElements(offsets, nullptr);
+    jlong* lengthValues = env->GetLongArrayElements(lengths, nullptr);
+    std::map<std::string, ModelSource> models;
+    for (jsize i = 0; i < count; ++i) {
+        auto name = static_cast<jstring>(env->GetObjectArrayElement(names, i));
+        const char* nameStr = env->GetStringUTFChars(name, nullptr);
+        models[nameStr] = modelFromFd(fdValues[i], offsetValues[i], static_cast<size_t>(lengthValues[i]));
+        env->ReleaseStringUTFChars(name, nameStr);
+        env->DeleteLocalRef(name);
+    }
+    env->ReleaseIntArrayElements(fds, fdValues, JNI_ABORT);
+    env->ReleaseLongArrayElements(offsets, offsetValues, JNI_ABORT);
+    env->ReleaseLongArrayElements(lengths, lengthValues, JNI_ABORT);
+
+    const char* configStr = env->GetStringUTFChars(configJson, nullptr);
+    bool result = engine.init(std::string(configStr), models);
+    env->ReleaseStringUTFChars(configJson, configStr);
+
+    return result;
+}
+
 // public native ProcessResult jni_process(String imagePath);
 JNIEXPORT jobject JNICALL
 Java_kl_open_fmandroid_NativeBridge_jni_1process(JNIEnv* env, jobject /* this */, jstring imagePath, jboolean skipLiveness) {
@@ -67,34 +171,20 @@ Java_kl_open_fmandroid_NativeBridge_jni_1process(JNIEnv* env, jobject /* this */
 
     ProcessResult result;
     if(skipLiveness) {
-        result = engine.process(std::string(pathStr), PipelineMode::SkipLiveness);
+        // Reference photos, the face may be small (ID documents)
+        result = engine.process(std::string(pathStr), PipelineMode::SkipLiveness, DetectorRange::Long);
     } else {
         result = engine.process(std::string(pathStr), PipelineMode::WholePipeline);
     }
 
     env->ReleaseStringUTFChars(imagePath, pathStr);
 
-    // Find the ProcessResult class
-    jclass resultClass = env->FindClass("kl/open/fmandroid/ProcessResult");
-    if (resultClass == nullptr) {
-        std::cerr << "[JNI] Failed to find ProcessResult class" << std::endl;
-        return nullptr;
-    }
-
-    // Get constructor ID
-    jmethodID constructor = env->GetMethodID(resultClass, "<init>",
-                                             "(ZZZZ[F)V");
-    if (constructor == nullptr) {
-        std::cerr << "[JNI] Failed to find ProcessResult constructor" << std::endl;
-        return nullptr;
-    }
-
     // Create jfloatArray for embedding
     jfloatArray embeddingArray = env->NewFloatArray(static_cast<jsize>(result.embedding.size()));
     env->SetFloatArrayRegion(embeddingArray, 0, static_cast<jsize>(result.embedding.size()), result.embedding.data());
 
     // Construct the result object
-    jobject resultObject = env->NewObject(resultClass, constructor,
+    jobject resultObject = env->NewObject(g_processResultClass, g_processResultCtor,
                                           static_cast<jboolean>(result.livenessChecked),
                                           static_cast<jboolean>(result.isLive),
                                           static_cast<jboolean>(result.faceDetected),
@@ -105,20 +195,89 @@ Java_kl_open_fmandroid_NativeBridge_jni_1process(JNIEnv* env, jobject /* this */
     return resultObject;
 }
 
+// public native int jni_processYuv(ByteBuffer yPlane, int yRowStride, ByteBuffer uPlane, ByteBuffer vPlane,
+//                                  int uvRowStride, int uvPixelStride, int width, int height,
+//                                  boolean skipLiveness, FloatBuffer result);
+// Planes are direct buffers as given by ImageProxy (YUV_420_888), read in place.
+JNIEXPORT jint JNICALL
+Java_kl_open_fmandroid_NativeBridge_jni_1processYuv(JNIEnv* env, jobject /* this */,
+                                                    jobject yPlane, jint yRowStride,
+                                                    jobject uPlane, jobject vPlane,
+                                                    jint uvRowStride, jint uvPixelStride,
+                                                    jint width, jint height,
+                                                    jboolean skipLiveness, jobject resultBuffer) {
+    Frame frame;
+    frame.format = uvPixelStride == 1 ? PixelFormat::I420 : PixelFormat::NV21;
+    frame.width = width;
+    frame.height = height;
+    frame.planes[0] = {directAddress(env, yPlane), yRowStride, 1};
+    frame.planes[1] = {directAddress(env, uPlane), uvRowStride, uvPixelStride};
+    frame.planes[2] = {directAddress(env, vPlane), uvRowStride, uvPixelStride};
+    if (!frame.planes[0].data || !frame.planes[1].data || !frame.planes[2].data) {
+        std::cerr << "[JNI] YUV planes must be direct buffers" << std::endl;
+        return -1;
+    }
+
+    ProcessResult result = engine.process(frame, skipLiveness ? PipelineMode::SkipLiveness : PipelineMode::WholePipeline);
+    return writeResult(env, result, resultBuffer);
+}
+
+// public native int jni_processRgba(ByteBuffer pixels, int rowStride, int width, int height,
+//                                   boolean skipLiveness, FloatBuffer result);
+JNIEXPORT jint JNICALL
+Java_kl_open_fmandroid_NativeBridge_jni_1processRgba(JNIEnv* env, jobject /* this */,
+                                                     jobject pixels, jint rowStride,
+                                                     jint width, jint height,
+                                                     jboolean skipLiveness, jobject resultBuffer) {
+    const uint8_t* data = directAddress(env, pixels);
+    if (data == nullptr) {
+        std::cerr << "[JNI] RGBA pixels must be a direct buffer" << std::endl;
+        return -1;
+    }
+
+    ProcessResult result = engine.process(data, width, height, rowStride, PixelFormat::RGBA,
+                                          skipLiveness ? PipelineMode::SkipLiveness : PipelineMode::WholePipeline);
+    return writeResult(env, result, resultBuffer);
+}
+
 // public native bool match(float[] embedding1, float[] embedding2);
 JNIEXPORT jboolean JNICALL
 Java_kl_open_fmandroid_NativeBridge_jni_1match(JNIEnv* env, jobject /* this */,
                                               jfloatArray emb1, jfloatArray emb2) {
     jsize len1 = env->GetArrayLength(emb1);
     jsize len2 = env->GetArrayLength(emb2);
+    if (len1 != len2 || len1 == 0) return false;
+
+    // Pin the arrays instead of copying them. Only the arithmetic runs while they are pinned,
+    // nothing that can block (logging included) until they are released.
+    auto* vec1 = static_cast<float*>(env->GetPrimitiveArrayCritical(emb1, nullptr));
+    auto* vec2 = static_cast<float*>(env->GetPrimitiveArrayCritical(emb2, nullptr));
+    bool pinned = vec1 && vec2;
+    float score = pinned ? engine.similarity(vec1, vec2, static_cast<size_t>(len1)) : 0.0f;
+    if (vec2) env->ReleasePrimitiveArrayCritical(emb2, vec2, JNI_ABORT);
+    if (vec1) env->ReleasePrimitiveArrayCritical(emb1, vec1, JNI_ABORT);
 
-    std::vector<float> vec1(len1);
-    std::vector<float> vec2(len2);
+    if (!pinned) {
+        std::cerr << "[JNI] Failed to access embedding arrays" << std::endl;
+        return false;
+    }
+    std::cout << "[JNI] Matching score: " << score << std::endl;
+    return engine.isMatch(score);
+}
 
-    env->GetFloatArrayRegion(emb1, 0, len1, vec1.data());
-    env->GetFloatArrayRegion(emb2, 0, len2, vec2.data());
+// public native bool jni_matchBuffers(FloatBuffer embedding1, FloatBuffer embedding2, int size);
+JNIEXPORT jboolean JNICALL
+Java_kl_open_fmandroid_NativeBridge_jni_1matchBuffers(JNIEnv* env, jobject /* this */,
+                                                     jobject emb1, jobject emb2, jint size) {
+    auto* vec1 = static_cast<const float*>(env->GetDirectBufferAddress(emb1));
+    auto* vec2 = static_cast<const float*>(env->GetDirectBufferAddress(emb2));
+    if (vec1 == nullptr || vec2 == nullptr || size <= 0 ||
+        env->GetDirectBufferCapacity(emb1) < size || env->GetDirectBufferCapacity(emb2) < size) {
+        std::cerr << "[JNI] Embeddings must be direct buffers holding at least " << size << " floats" << std::endl;
+        return false;
+    }
 
-    return engine.match(vec1, vec2);
+    return engine.match(vec1, vec2, static_cast<size_t>(size));
 }
 
 // public native void reset();
@@ -3,8 +3,6 @@ package kl.open.fmandroid
 import android.Manifest
 import android.content.pm.PackageManager
 import android.graphics.Bitmap
-import android.graphics.BitmapFactory
-import android.graphics.Matrix
 import android.os.Bundle
 import android.util.Size
 import android.widget.Toast
@@ -17,11 +15,25 @@ import androidx.camera.lifecycle.ProcessCameraProvider
 import androidx.camera.view.PreviewView
 import androidx.core.content.ContextCompat
 import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
+import java.util.concurrent.Executors
 
 class CameraActivity : AppCompatActivity() {
 
-    private lateinit var imageCapture: ImageCapture
     private lateinit var previewView: PreviewView
+    private val analysisExecutor = Executors.newSingleThreadExecutor()
+    private val resultBuffer = NativeBridge.allocateResultBuffer()
+    // Embedding part of resultBuffer, matched in place against the reference
+    private val capturedEmbedding: FloatBuffer = resultBuffer.let {
+        it.position(NativeBridge.RESULT_HEADER_SIZE)
+        val embedding = it.slice()
+        it.rewind()
+        embedding
+    }
+    private var referenceEmbedding: FloatBuffer? = null
+    @Volatile private var finished = false
 
     private val requestPermissionLauncher = registerForActivityResult(
         ActivityResultContracts.RequestPermission()
@@ -35,17 +47,16 @@ class CameraActivity : AppCompatActivity() {
         }
     }
 
-    private fun imageProxyToBitmap(imageProxy: ImageProxy): Bitmap? {
-        val planeProxy = imageProxy.planes[0]
-        val buffer = planeProxy.buffer
-        val bytes = ByteArray(buffer.remaining())
-        buffer.get(bytes)
-        return BitmapFactory.decodeByteArray(bytes, 0, bytes.size)
-    }
-
     override fun onCreate(savedInstanceState: Bundle?) {
         super.onCreate(savedInstanceState)
 
+        referenceEmbedding = CameraCallbackHolder.referenceResult?.embedding?.let { embedding ->
+            ByteBuffer.allocateDirect(embedding.size * Float.SIZE_BYTES)
+                .order(ByteOrder.nativeOrder())
+                .asFloatBuffer()
+                .apply { put(embedding); rewind() }
+        }
+
         previewView = PreviewView(this)
         previewView.scaleX = -1f
         setContentView(previewView)
@@ -77,106 +88,84 @@ class CameraActivity : AppCompatActivity() {
                 )
                 .build()
 
-            imageCapture = ImageCapture.Builder()
+            // Upright RGBA frames, as expected by NativeBridge.processImageProxy
+            val imageAnalysis = ImageAnalysis.Builder()
                 .setResolutionSelector(resolutionSelector)
+                .setBackpressureStrategy(ImageAnalysis.STRATEGY_KEEP_ONLY_LATEST)
+                .setOutputImageFormat(ImageAnalysis.OUTPUT_IMAGE_FORMAT_RGBA_8888)
+                .setOutputImageRotationEnabled(true)
                 .build()
+            imageAnalysis.setAnalyzer(analysisExecutor, ::analyzeFrame)
 
             val cameraSelector = CameraSelector.DEFAULT_FRONT_CAMERA
 
             cameraProvider.unbindAll()
-            cameraProvider.bindToLifecycle(this, cameraSelector, preview, imageCapture)
-
-            // Start the first frame capture
-            captureFrame()
+            cameraProvider.bindToLifecycle(this, cameraSelector, preview, imageAnalysis)
 
         }, ContextCompat.getMainExecutor(this))
     }
 
-    private fun captureFrame() {
-        val finalFile = File(getExternalFilesDir(null), "captured_frame_${System.currentTimeMillis()}.png")
-
-        val imageCaptureCallback = object : ImageCapture.OnImageCapturedCallback() {
-            override fun onCaptureSuccess(imageProxy: ImageProxy) {
-                // Convert raw ImageProxy to Bitmap
-                val bitmap = imageProxyToBitmap(imageProxy)
-                // Read the correct rotation from the ImageProxy metadata
-                val rotationDegrees = imageProxy.imageInfo.rotationDegrees.toFloat()
-                // Close the ImageProxy early to free camera resources
-                imageProxy.close()
-
-                // If we got a valid Bitmap, rotate and save as PNG
-                if (bitmap != null) {
-                    // Rotate the bitmap to upright orientation
-                    val matrix = Matrix().apply { if (rotationDegrees != 0f) postRotate(rotationDegrees) }
-                    val rotatedBitmap = Bitmap.createBitmap(
-                        bitmap, 0, 0, bitmap.width, bitmap.height, matrix, true
-                    )
-
-                    // Save as lossless PNG
-                    finalFile.outputStream().use { out ->
-                        rotatedBitmap.compress(Bitmap.CompressFormat.PNG, 100, out)
-                    }
-
-                    // Pass the saved file path into the processing pipeline
-                    processCapturedImage(finalFile.absolutePath)
-                } else {
-                    // On error, report a failure result and clean up
-                    CameraCallbackHolder.onFinalResult?.invoke(MatchResult.error())
-                    CameraCallbackHolder.reset()
-                    finish()
-                }
-            }
+    private fun analyzeFrame(imageProxy: ImageProxy) {
+        val decisor = CameraCallbackHolder.decisor
+        val reference = referenceEmbedding
+        try {
+            if (finished || decisor == null || reference == null) return
 
-            override fun onError(exception: ImageCaptureException) {
-                CameraCallbackHolder.onFinalResult?.invoke(MatchResult.error())
-                CameraCallbackHolder.reset()
-                finish()
+            // The planes are processed in place, no Bitmap or PNG round trip
+            val written = NativeBridge.processImageProxy(imageProxy, false, resultBuffer)
+            if (written < 0 || resultBuffer.get(NativeBridge.RESULT_FACE_DETECTED) == 0f) {
+                // No face detected, just wait for the next frame
+                return
             }
-        }
 
-        imageCapture.takePicture(
-            ContextCompat.getMainExecutor(this),
-            imageCaptureCallback
-        )
-    }
+            val isLive = resultBuffer.get(NativeBridge.RESULT_IS_LIVE) != 0f
+            val embeddingSize = resultBuffer.get(NativeBridge.RESULT_EMBEDDING_SIZE).toInt()
+            val isSameSubject = embeddingSize == reference.capacity() &&
+                NativeBridge.jni_matchBuffers(reference, capturedEmbedding, embeddingSize)
 
+            // Only live matching frames can end up in the final result, keep those as PNG
+            val capturedPath = if (isLive && isSameSubject) saveFrame(imageProxy) else null
 
-    private fun processCapturedImage(imagePath: String) {
-        try {
-            val capturedResult = NativeBridge.jni_process(imagePath, false)
-
-            if (capturedResult.faceDetected) {
-                val isSameSubject = CameraCallbackHolder.referenceResult?.embedding?.let {
-                    NativeBridge.jni_match(it, capturedResult.embedding)
-                } ?: false
-
-                val sample = MatchResult(
+            decisor.addSample(
+                MatchResult(
                     processed = true,
                     referenceIsValid = true,
-                    capturedIsLive = capturedResult.isLive,
+                    capturedIsLive = isLive,
                     isSameSubject = isSameSubject,
-                    capturedPath = imagePath
+                    capturedPath = capturedPath
                 )
+            )
 
-                CameraCallbackHolder.decisor?.addSample(sample)
-
-                if (CameraCallbackHolder.decisor?.isReady() == true) {
-                    finishCapture()
-                } else {
-                    captureFrame()
-                }
-
-            } else {
-                // No face detected, just retry another capture
-                captureFrame()
+            if (decisor.isReady()) {
+                finished = true
+                runOnUiThread { finishCapture() }
             }
         } catch (e: Exception) {
-            CameraCallbackHolder.onFinalResult?.invoke(MatchResult.error())
-            CameraCallbackHolder.reset()
-            finish()
+            finished = true
+            runOnUiThread {
+                CameraCallbackHolder.onFinalResult?.invoke(MatchResult.error())
+                CameraCallbackHolder.reset()
+                finish()
+            }
+        } finally {
+            // Releases the frame to the camera
+            imageProxy.close()
         }
     }
 
+    private fun saveFrame(imageProxy: ImageProxy): String {
+        val file = File(getExternalFilesDir(null), "captured_frame_${System.currentTimeMillis()}.png")
+        file.outputStream().use { out ->
+            imageProxy.toBitmap().compress(Bitmap.CompressFormat.PNG, 100, out)
+        }
+        return file.absolutePath
+    }
+
+    override fun onDestroy() {
+        super.onDestroy()
+        analysisExecutor.shutdown()
+    }
+
     private fun finishCapture() {
         val finalResult = CameraCallbackHolder.decisor?.aggregate() ?: MatchResult.error()
         CameraCallbackHolder.onFinalResult?.invoke(finalResult)
@@ -3,7 +3,9 @@ package kl.open.fmandroid
 
 import android.content.Context
 import android.content.Intent
+import android.content.res.AssetFileDescriptor
 import org.json.JSONObject
+import java.io.IOException
 
 class FaceMatchSdkImpl(private val context: Context) : FaceMatchSDK {
 
@@ -15,23 +17,37 @@ class FaceMatchSdkImpl(private val context: Context) : FaceMatchSDK {
 
     override fun init(configJson: String): Boolean {
 
-        val modelBasePath = context.filesDir.absolutePath
         val parsedConfig = JSONObject(configJson)
 
-        val livenessModel0 = parsedConfig.optString("liveness_model0")
-        val livenessModel1 = parsedConfig.optString("liveness_model1")
-        val faceDetectorModel = parsedConfig.optString("face_detector_model")
-        val embeddingModel = parsedConfig.optString("embedding_extractor_model")
-
-        // Copy models from assets to internal storage
-        copyAssetIfNeeded(livenessModel0, modelBasePath)
-        copyAssetIfNeeded(livenessModel1, modelBasePath)
-        copyAssetIfNeeded(faceDetectorModel, modelBasePath)
-        copyAssetIfNeeded(embeddingModel, modelBasePath)
+        val models = listOf(
+            "liveness_model0", "liveness_model1", "liveness_ensemble_model",
+            "face_detector_model", "face_detector_short_model", "embedding_extractor_model"
+        ).mapNotNull { key -> parsedConfig.optString(key).takeIf { it.isNotEmpty() } }
 
         //TODO it should be called only if the library was built in debug mode
         NativeBridge.jni_setDebugSavePath(context.cacheDir.absolutePath)
 
+        // Uncompressed assets (noCompress "onnx") are read in place from the APK
+        val descriptors = models.map { openAssetFd(it) }
+        try {
+            if (descriptors.all { it != null }) {
+                val fds = descriptors.filterNotNull()
+                return NativeBridge.jni_initWithModels(
+                    configJson,
+                    models.toTypedArray(),
+                    fds.map { it.parcelFileDescriptor.fd }.toIntArray(),
+                    fds.map { it.startOffset }.toLongArray(),
+                    fds.map { it.length }.toLongArray()
+                )
+            }
+        } finally {
+            descriptors.forEach { it?.close() }
+        }
+
+        // Compressed assets can't be mapped, copy them to internal storage
+        val modelBasePath = context.filesDir.absolutePath
+        models.forEach { copyAssetIfNeeded(it, modelBasePath) }
+
         return NativeBridge.jni_init(configJson, modelBasePath)
     }
 
@@ -67,6 +83,14 @@ class FaceMatchSdkImpl(private val context: Context) : FaceMatchSDK {
         TODO("Not yet implemented")
     }
 
+    private fun openAssetFd(assetName: String): AssetFileDescriptor? {
+        return try {
+            context.assets.openFd(assetName)
+        } catch (e: IOException) {
+            null
+        }
+    }
+
     private fun copyAssetIfNeeded(assetName: String, destDir: String) {
         val destFile = java.io.File(destDir, assetName)
         if (!destFile.exists()) {
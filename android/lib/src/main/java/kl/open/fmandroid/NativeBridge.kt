@@ -1,12 +1,81 @@
 package kl.open.fmandroid
 
+import android.graphics.ImageFormat
+import android.graphics.PixelFormat
+import androidx.camera.core.ImageProxy
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
+
 object NativeBridge {
 
+    // Layout of the FloatBuffer filled by jni_processYuv / jni_processRgba (see lib.cpp)
+    const val RESULT_LIVENESS_CHECKED = 0
+    const val RESULT_IS_LIVE = 1
+    const val RESULT_FACE_DETECTED = 2
+    const val RESULT_EMBEDDING_EXTRACTED = 3
+    const val RESULT_LIVENESS_SCORE = 4
+    const val RESULT_EMBEDDING_SIZE = 5
+    const val RESULT_HEADER_SIZE = 6
+
     @JvmStatic external fun jni_init(configJson: String, basePath: String): Boolean
+
+    /**
+     * Same as [jni_init], model i of the config is the byte range [offsets] i, [lengths] i of
+     * [fds] i (e.g. an AssetFileDescriptor), read in place. The descriptors can be closed afterwards.
+     */
+    @JvmStatic external fun jni_initWithModels(
+        configJson: String, names: Array<String>, fds: IntArray, offsets: LongArray, lengths: LongArray
+    ): Boolean
     @JvmStatic external fun jni_process(imagePath: String, skipLiveness: Boolean): ProcessResult
     @JvmStatic external fun jni_match(embedding1: FloatArray, embedding2: FloatArray): Boolean
     @JvmStatic external fun jni_reset()
 
+    /**
+     * Zero-copy processing of YUV_420_888 planes. All buffers must be direct, [result] receives
+     * the RESULT_* header followed by the embedding. Returns the number of floats written or -1.
+     */
+    @JvmStatic external fun jni_processYuv(
+        yPlane: ByteBuffer, yRowStride: Int,
+        uPlane: ByteBuffer, vPlane: ByteBuffer, uvRowStride: Int, uvPixelStride: Int,
+        width: Int, height: Int, skipLiveness: Boolean, result: FloatBuffer
+    ): Int
+
+    /** Same as [jni_processYuv] for RGBA_8888 pixels. */
+    @JvmStatic external fun jni_processRgba(
+        pixels: ByteBuffer, rowStride: Int, width: Int, height: Int,
+        skipLiveness: Boolean, result: FloatBuffer
+    ): Int
+
+    /** Matches two embeddings held in direct buffers without copying them. */
+    @JvmStatic external fun jni_matchBuffers(embedding1: FloatBuffer, embedding2: FloatBuffer, size: Int): Boolean
+
     /** TODO debug only: tell native code where to dump debug images */
     @JvmStatic external fun jni_setDebugSavePath(path: String)
-}
\ No newline at end of file
+
+    /** Allocates a direct result buffer for the zero-copy process calls. */
+    @JvmStatic fun allocateResultBuffer(maxEmbeddingSize: Int = 512): FloatBuffer {
+        return ByteBuffer.allocateDirect((RESULT_HEADER_SIZE + maxEmbeddingSize) * Float.SIZE_BYTES)
+            .order(ByteOrder.nativeOrder())
+            .asFloatBuffer()
+    }
+
+    /**
+     * Runs the pipeline directly on the planes of a CameraX frame (YUV_420_888 or RGBA_8888).
+     * The frame must be upright, e.g. from an ImageAnalysis with output rotation enabled.
+     */
+    @JvmStatic fun processImageProxy(image: ImageProxy, skipLiveness: Boolean, result: FloatBuffer): Int {
+        val planes = image.planes
+        return when (image.format) {
+            ImageFormat.YUV_420_888 -> jni_processYuv(
+                planes[0].buffer, planes[0].rowStride,
+                planes[1].buffer, planes[2].buffer, planes[1].rowStride, planes[1].pixelStride,
+                image.width, image.height, skipLiveness, result
+            )
+            PixelFormat.RGBA_8888 -> jni_processRgba(
+                planes[0].buffer, planes[0].rowStride, image.width, image.height, skipLiveness, result
+            )
+            else -> -1
+        }
+    }
+}
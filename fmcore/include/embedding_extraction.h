@@ -1,8 +1,54 @@
 #pragma once
 #include <opencv2/core.hpp>
+#include <memory>
+#include <shared_mutex>
 #include <vector>
 #include <string>
 #include <onnxruntime_cxx_api.h>
+#include "ort_session.h"
+#include "tensor_kernels.h"
+#include "utils.h"
+#include "FMCore.h"
 
-bool init_embedding_extractor(Ort::SessionOptions& options, const std::string& model_path);
-std::vector<float> extract_embedding(const cv::Mat& aligned_face);
+// "embedding_extractor" section of config.json
+struct EmbeddingOptions {
+    // Aligned face size when the model leaves its input size symbolic
+    int input_size = 112;
+    // Maps pixels to [-1,1]
+    TensorNorm norm{127.5f, 1.0f / 127.5f};
+};
+
+class EmbeddingExtractor {
+public:
+    // The aligned face size and the embedding size are read from the model
+    bool init(const OrtSettings& settings, const ModelFile& model, const EmbeddingOptions& options);
+    // run_options can be terminated from another thread, the Run then throws Ort::Exception
+    std::vector<float> extract_embedding(const cv::Mat& aligned_face,
+                                         const Ort::RunOptions& run_options = Ort::RunOptions{nullptr});
+    // Extracts one embedding per face with a single batched Run (empty faces give empty embeddings)
+    std::vector<std::vector<float>> extract_embedding(const std::vector<cv::Mat>& aligned_faces,
+                                                      const Ort::RunOptions& run_options = Ort::RunOptions{nullptr});
+    // Aligns faces[i] of frames[i] straight into the input tensor, no intermediate aligned image
+    std::vector<float> extract_embedding(const Frame& frame, const FaceDetectionResult& face,
+                                         const Ort::RunOptions& run_options = Ort::RunOptions{nullptr});
+    std::vector<std::vector<float>> extract_embedding(const std::vector<Frame>& frames,
+                                                      const std::vector<FaceDetectionResult>& faces,
+                                                      const Ort::RunOptions& run_options = Ort::RunOptions{nullptr});
+    // Same for count faces into embeddings[i], whose storage is reused: doesn't allocate once the
+    // vectors have held an embedding
+    void extract_embedding(const Frame* frames, const FaceDetectionResult* faces, size_t count,
+                           std::vector<float>* embeddings,
+                           const Ort::RunOptions& run_options = Ort::RunOptions{nullptr});
+    void release();
+
+private:
+    // fill(n, dst) writes face n into its slot of the input tensor and returns false if it can't
+    template <typename Fill>
+    void run_batch(size_t count, const Fill& fill, std::vector<float>* embeddings, const Ort::RunOptions& run_options);
+
+    std::unique_ptr<ModelSession> embedding_model;
+    std::shared_mutex embedding_mutex;
+
+    int embedding_input_size = 112;
+    TensorNorm input_norm{127.5f, 1.0f / 127.5f};
+};
@@ -1,5 +1,10 @@
 #pragma once
 #include <opencv2/core.hpp>
 #include "utils.h"
+#include "FMCore.h"
+#include "tensor_kernels.h"
 
 cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceDetected);
+// Warps the aligned out_size x out_size face straight from the frame into a normalized RGB CHW tensor
+bool align_face_to_tensor(const Frame& frame, const FaceDetectionResult& faceDetected, int out_size,
+                          const TensorNorm& norm, float* dst);
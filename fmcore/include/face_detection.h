@@ -1,8 +1,58 @@
 #pragma once
 #include <opencv2/core.hpp>
+#include <memory>
+#include <shared_mutex>
 #include <vector>
 #include <onnxruntime_cxx_api.h>
+#include "ort_session.h"
+#include "tensor_kernels.h"
 #include "utils.h"
+#include "FMCore.h"
 
-bool init_face_detector(Ort::SessionOptions& options, const std::string& model_path, bool short_range);
-std::vector<FaceDetectionResult> detect_faces(const cv::Mat& image);
+// "face_detector" section of config.json
+struct FaceDetectorOptions {
+    // Letterbox size when the model leaves its input size symbolic (128 short range, 256 full range)
+    int input_size = 256;
+    // Raw [0,255] pixels by default
+    TensorNorm norm;
+    // Only decode the highest-scoring face, no NMS over the other candidates
+    bool best_face_only = false;
+    // Replace each face by the score-weighted average of the candidates it suppresses (BlazeFace's
+    // weighted NMS), steadier boxes and landmarks from frame to frame
+    bool blend_boxes = false;
+};
+
+class FaceDetector {
+public:
+    // Input size, anchor count and the scores/boxes/landmarks outputs are read from the model
+    bool init(const OrtSettings& settings, const ModelFile& model, const FaceDetectorOptions& options);
+    std::vector<FaceDetectionResult> detect_faces(const cv::Mat& image);
+    std::vector<FaceDetectionResult> detect_faces(const Frame& frame);
+    // Detects on several frames with one batched Run (per-frame Runs if the model has a fixed batch)
+    std::vector<std::vector<FaceDetectionResult>> detect_faces(const std::vector<Frame>& frames);
+    // Same, faces[i] receives the faces of frames[i]. The vectors are cleared and refilled, so callers
+    // that keep them between frames don't allocate once their capacity is reached.
+    void detect_faces(const Frame* frames, size_t count, std::vector<FaceDetectionResult>* faces);
+    void release();
+
+private:
+    bool preprocess_image(const Frame& frame, float& scale_out, float* dst) const;
+    void decode_detections(const float* scores, const float* boxes, const float* landmarks, int anchors,
+                           int landmark_count, float scale, std::vector<FaceDetectionResult>& results) const;
+
+    // Session::Run is thread-safe: inference only takes the lock shared, init takes it exclusively
+    std::unique_ptr<ModelSession> face_model;
+    std::shared_mutex session_mutex;
+
+    int input_width = 256;
+    int input_height = 256;
+    TensorNorm input_norm;
+    // Output indices of the per-anchor scores [N,A,1], boxes [N,A,4] and landmarks [N,A,2*K]
+    size_t score_output = 0;
+    size_t box_output = 1;
+    size_t landmark_output = 2;
+    float threshold = 0.6f;
+    float iou_threshold = 0.3f;
+    bool best_face_only = false;
+    bool blend_boxes = false;
+};
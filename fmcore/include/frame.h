@@ -0,0 +1,28 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include "FMCore.h"
+
+// BT.601 YUV -> RGB coefficients
+struct YuvCoeffs {
+    float yOffset;
+    float yScale;
+    float rv;
+    float gu;
+    float gv;
+    float bu;
+};
+
+// Video range matches OpenCV's COLOR_YUV2RGB_* conversions
+const YuvCoeffs& yuv_coeffs(const Frame& frame);
+
+bool is_yuv_format(PixelFormat format);
+// Bytes per pixel of the packed formats, 0 for YUV
+int packed_channels(PixelFormat format);
+bool validate_frame(const Frame& frame);
+
+// Wraps a CV_8UC3 BGR image as a Frame without copying
+Frame frame_from_mat(const cv::Mat& bgr);
+
+// Returns a BGR image for the whole frame: BGR buffers are wrapped without copying,
+// every other format is converted in one pass.
+cv::Mat frame_to_bgr(const Frame& frame);
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+// A model that is loaded on first use (or up front) and can be released and loaded again later.
+// ensure_loaded() is a single atomic load once the model is in, so it can guard every request.
+// A loader that fails isn't run again until configure() gives it a new one, so a missing or broken
+// model costs one failed load rather than one per request.
+class LazyModel {
+public:
+    // Replaces the loader, a model loaded with the previous one is released
+    void configure(std::function<bool()> load, std::function<void()> release) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (loaded && release_model) release_model();
+        loaded = false;
+        failed = false;
+        load_model = std::move(load);
+        release_model = std::move(release);
+    }
+
+    bool ensure_loaded() {
+        if (loaded.load(std::memory_order_acquire)) return true;
+        if (failed.load(std::memory_order_acquire)) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded && !failed && load_model) {
+            const bool ok = load_model();
+            loaded.store(ok, std::memory_order_release);
+            failed.store(!ok, std::memory_order_release);
+        }
+        return loaded;
+    }
+
+    void unload() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) return;
+        release_model();
+        loaded = false;
+    }
+
+private:
+    std::mutex mutex;
+    std::atomic<bool> loaded{false};
+    std::atomic<bool> failed{false};
+    std::function<bool()> load_model;
+    std::function<void()> release_model;
+};
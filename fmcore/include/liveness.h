@@ -1,14 +1,65 @@
 #pragma once
 
 #include <opencv2/core.hpp>
+#include <memory>
+#include <shared_mutex>
+#include <cstdint>
+#include <string>
+#include <vector>
 #include <onnxruntime_cxx_api.h>
+#include "ort_session.h"
+#include "tensor_kernels.h"
 #include "utils.h"
+#include "FMCore.h"
+#include "thread_pool.h"
 
 struct LivenessResult {
     bool isLive = false;
     float score = -1.0;
 };
 
-bool init_liveness_detector(Ort::SessionOptions& session_options, const std::vector<std::string>& model_paths, const float liveness_thresh);
-LivenessResult run_liveness_check(const cv::Mat& input_image, const FaceDetectionResult& face);
-void release_liveness_detector();
+// "liveness" section of config.json
+struct LivenessOptions {
+    // Member m looks at the face box scaled by crop_scales[m] around its center
+    std::vector<float> crop_scales{4.0f, 2.7f};
+    // Crop size when a model leaves its input size symbolic
+    int input_size = 80;
+    // Raw [0,255] pixels by default
+    TensorNorm norm;
+    // Class whose softmax probability is the member's score
+    int real_class = 1;
+};
+
+class LivenessDetector {
+public:
+    // Each member of the ensemble is a model of its own, or an input/output pair of a single fused
+    // graph (in crop_scales order). Crop sizes and class counts are read from the models.
+    // parallel_members runs separate models side by side.
+    bool init(const OrtSettings& settings, const std::vector<ModelFile>& models,
+              const float liveness_thresh, const LivenessOptions& options, bool parallel_members = false);
+    LivenessResult run_liveness_check(const cv::Mat& input_image, const FaceDetectionResult& face);
+    LivenessResult run_liveness_check(const Frame& frame, const FaceDetectionResult& face);
+    // Checks faces[i] in frames[i], one Run per model for the whole batch
+    std::vector<LivenessResult> run_liveness_check(const std::vector<Frame>& frames,
+                                                   const std::vector<FaceDetectionResult>& faces);
+    // Same for count faces, writes results[i]. Doesn't allocate once warmed up (without parallel members).
+    void run_liveness_check(const Frame* frames, const FaceDetectionResult* faces, size_t count,
+                            LivenessResult* results);
+    void release();
+
+private:
+    void run_members(ModelSession& model, size_t first_member, size_t member_count, const Frame* frames,
+                     const FaceDetectionResult* faces, size_t count,
+                     std::vector<float>* real_probs, std::vector<uint8_t>* valid) const;
+
+    std::vector<std::unique_ptr<ModelSession>> liveness_models;
+    std::shared_mutex liveness_mutex;
+    bool fused_ensemble = false;
+    std::vector<float> crop_scales;
+    // Input crop size of each member
+    std::vector<cv::Size> member_sizes;
+    TensorNorm input_norm;
+    int real_class = 1;
+    std::unique_ptr<ThreadPool> member_pool;
+    float liveness_thresh = 0.0f;
+};
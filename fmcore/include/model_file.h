@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "FMCore.h"
+
+// A model to create a session from: a file path, or a ModelSource handed to FMCore::init.
+// The file descriptor of an fd source is duplicated and closed with the last copy.
+class ModelFile {
+public:
+    // Bytes of a memory or fd source, an fd range stays mapped read-only while the view lives
+    class View {
+    public:
+        View() = default;
+        View(const View&) = delete;
+        View& operator=(const View&) = delete;
+        ~View();
+
+        const void* data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        friend class ModelFile;
+        const void* bytes = nullptr;
+        size_t length = 0;
+        void* mapping = nullptr;
+        size_t mapping_size = 0;
+    };
+
+    ModelFile() = default;
+    ModelFile(const std::string& path);
+    // name is the model's file name in the config, used for logs and cache artifacts
+    ModelFile(const std::string& name, const ModelSource& source);
+
+    // The path, or the config name of a ModelSource
+    const std::string& name() const { return model_name; }
+    bool is_path() const { return !source; }
+    // Whether the file can be opened or the source holds bytes, without reading the model
+    bool available() const;
+    // Exposes the bytes of a ModelSource, false for paths or if the range can't be mapped
+    bool map(View& view) const;
+
+private:
+    struct Source;
+    std::string model_name;
+    std::shared_ptr<const Source> source;
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include <onnxruntime_cxx_api.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "model_file.h"
+
+// ORT settings from the "ort_options" section of config.json. Thread, spinning and arena settings
+// given at the top level configure the shared environment; a model that sets its own thread count
+// gets a private pool instead of the global one.
+struct OrtSettings {
+    int intra_op_threads = 1;
+    int inter_op_threads = 1;
+    bool allow_spinning = true;
+    GraphOptimizationLevel optimization = ORT_ENABLE_BASIC;
+    ExecutionMode execution_mode = ORT_SEQUENTIAL;
+    bool memory_pattern = true;
+    bool cpu_arena = true;
+    int arena_extend_strategy = -1;  // -1 ORT default, 0 next power of two, 1 same as requested
+    size_t arena_max_mem = 0;        // 0 ORT default
+    bool own_threads = false;
+    // Keep optimized graphs in ORT format, next to the models unless model_cache_dir is set
+    bool model_cache = false;
+    std::string model_cache_dir;
+};
+
+// Sets the global pools and shared arena of ort_env(). The first call wins, even before the environment
+// exists; later calls return false if their settings differ (they can't change for the life of the process)
+bool configure_ort_env(const OrtSettings& settings);
+// Process-wide ORT environment shared by every model: one global intra-op/inter-op thread pool
+// and one CPU arena registered as the shared allocator, created on first use
+Ort::Env& ort_env();
+// Options for a session of ort_env(): global pools and the shared arena unless settings opt out
+Ort::SessionOptions make_session_options(const OrtSettings& settings);
+// Loads a model into ort_env(), in-memory sources through ORT's from-memory constructor. With
+// settings.model_cache the graph optimized under settings is saved in ORT format on the first load
+// and loaded as is afterwards (in-memory sources need model_cache_dir). Artifacts are keyed by model
+// content, ORT version, the session options and the host CPU features; stale ones of the same model
+// are removed.
+std::unique_ptr<Ort::Session> create_session(const ModelFile& model, const OrtSettings& settings);
+
+// Names and shapes of a session's inputs and outputs, resolved once at init
+struct SessionIO {
+    std::vector<std::string> input_names;
+    std::vector<std::string> output_names;
+    std::vector<std::vector<int64_t>> input_shapes;
+    std::vector<std::vector<int64_t>> output_shapes;
+};
+
+SessionIO describe_session(const Ort::Session& session);
+
+// One reusable IoBinding with its own input and output buffers. Buffers and bindings are only
+// rebuilt when the batch size changes, so a steady-state Run doesn't allocate on our side and
+// ORT writes the outputs straight into the preallocated buffers.
+class BoundRun {
+public:
+    BoundRun(Ort::Session& session, const SessionIO& io);
+
+    // Binds buffers for batch rows, nothing to do when the batch size is unchanged
+    void bind(int64_t batch);
+    float* input(size_t index) { return inputs[index].data(); }
+    const float* output(size_t index) const;
+    // Number of output floats per batch row
+    size_t output_row_size(size_t index) const;
+    void run(const Ort::RunOptions& options);
+    // Number of run() calls in progress on the calling thread, so allocations made inside ORT's Run
+    // can be told apart from the wrapper's (fmcore_alloc_test)
+    static int in_progress();
+
+private:
+    Ort::Session& session;
+    const SessionIO& io;
+    Ort::MemoryInfo mem_info;
+    Ort::IoBinding binding;
+    int64_t bound_batch = 0;
+    std::vector<std::vector<float>> inputs;
+    std::vector<std::vector<float>> outputs;
+    std::vector<size_t> output_rows;
+    // Outputs with dynamic dimensions other than the batch are allocated by ORT on each Run
+    std::vector<bool> ort_allocated;
+    std::vector<Ort::Value> ort_outputs;
+};
+
+// A loaded model: the session, its I/O description and a pool of BoundRuns handed out to
+// concurrent callers. A caller keeps its BoundRun for the lease and returns it afterwards,
+// so the pool grows to the concurrency level once and is then reused.
+class ModelSession {
+public:
+    class Lease {
+    public:
+        Lease(ModelSession& model, std::unique_ptr<BoundRun> run) : model(&model), run(std::move(run)) {}
+        Lease(Lease&& other) noexcept = default;
+        ~Lease() { if (run) model->give_back(std::move(run)); }
+        BoundRun* operator->() { return run.get(); }
+        BoundRun& operator*() { return *run; }
+
+    private:
+        ModelSession* model;
+        std::unique_ptr<BoundRun> run;
+    };
+
+    explicit ModelSession(std::unique_ptr<Ort::Session> session);
+
+    Ort::Session& session() { return *ort_session; }
+    const SessionIO& io() const { return session_io; }
+    // True when the first dimension of the first input is symbolic, i.e. several images fit in one Run
+    bool dynamic_batch() const;
+    // Replaces the declared shape of an input (batch dimension included), e.g. to fix symbolic sizes
+    void set_input_shape(size_t index, const std::vector<int64_t>& shape) { session_io.input_shapes[index] = shape; }
+    // Resolves the height and width of an NCHW RGB image input: the model's own dimensions, or
+    // fallback_size where they are symbolic. Fixes the input shape to them, false if the input
+    // isn't a 3-channel image.
+    bool resolve_image_input(size_t index, int fallback_size, int& height, int& width);
+
+    Lease acquire();
+
+private:
+    void give_back(std::unique_ptr<BoundRun> run);
+
+    std::unique_ptr<Ort::Session> ort_session;
+    SessionIO session_io;
+    std::mutex pool_mutex;
+    std::vector<std::unique_ptr<BoundRun>> idle_runs;
+};
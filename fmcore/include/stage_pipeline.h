@@ -0,0 +1,41 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "bounded_queue.h"
+#include "utils.h"
+#include "FMCore.h"
+
+// State of one request travelling through the pipeline stages.
+struct PipelineJob {
+    Frame frame;
+    PipelineMode mode = PipelineMode::WholePipeline;
+    DetectorRange range = DetectorRange::Auto;
+    ProcessResult result;
+    std::vector<FaceDetectionResult> faces;
+    std::function<void(ProcessResult)> done;
+};
+
+// Runs each stage on its own thread, connected by bounded queues, so consecutive
+// jobs overlap: while job N is in the last stage, job N+1 can be in the first one.
+// A stage returns false when the job is finished early (no face, spoof, ...).
+class StagePipeline {
+public:
+    using Stage = std::function<bool(PipelineJob&)>;
+
+    StagePipeline(std::vector<Stage> stages, size_t queue_depth);
+    // Finishes every queued job before joining the stage threads
+    ~StagePipeline();
+
+    // Blocks while the first queue is full. Returns false if the pipeline is shutting down, after
+    // calling the job's done with an empty result.
+    bool submit(std::unique_ptr<PipelineJob> job);
+
+private:
+    void run_stage(size_t index);
+
+    std::vector<Stage> stages;
+    std::vector<std::unique_ptr<BoundedQueue<std::unique_ptr<PipelineJob>>>> queues;
+    std::vector<std::thread> workers;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <opencv2/core.hpp>
+#include "FMCore.h"
+
+// Normalization applied while writing tensor values: (pixel - mean) * scale
+struct TensorNorm {
+    float mean = 0.0f;
+    float scale = 1.0f;
+};
+
+// Bilinear resample of roi (clipped to the frame) into the top-left out_size corner of a planar
+// RGB CHW float tensor of tensor_size, the rest is padded with black. Color conversion, channel
+// order and normalization happen in the same pass, no intermediate image is created and the
+// per-thread scratch rows are reused between calls.
+bool resize_to_tensor(const Frame& frame, const cv::Rect& roi, const cv::Size& out_size,
+                      const cv::Size& tensor_size, const TensorNorm& norm, float* dst);
+
+// Bilinear warp into a planar RGB CHW float tensor of out_size: output pixel (x, y) samples the
+// frame at dst_to_src * (x, y, 1), coordinates outside the frame are clamped (BORDER_REPLICATE).
+bool warp_to_tensor(const Frame& frame, const cv::Matx23f& dst_to_src, const cv::Size& out_size,
+                    const TensorNorm& norm, float* dst);
+
+// Writes the indices of the scores at or above threshold to indices (room for count), in ascending
+// order, and returns how many there are. Blocks of scores below threshold cost one vector compare.
+int select_scores(const float* scores, int count, float threshold, int* indices);
@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for running pipeline branches next to the calling thread.
+// Tasks must not wait on other tasks of the same pool.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count);
+    // Runs the tasks already queued, then joins the workers
+    ~ThreadPool();
+
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged]() { (*packaged)(); });
+        }
+        task_available.notify_one();
+        return future;
+    }
+
+    size_t size() const { return workers.size(); }
+
+private:
+    void run_worker();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable task_available;
+    bool stopping = false;
+};
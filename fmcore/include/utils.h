@@ -3,13 +3,31 @@
 #ifdef FMCORE_NATIVE_BUILD
     #include <opencv2/highgui.hpp>
 #endif
+#include <array>
+#include <type_traits>
 #include <vector>
 
+// One detected face. Trivially copyable, so results are copied between stages and into batches
+// without touching the heap. Landmarks are in the MediaPipe face detector order, sides are the subject's.
 struct FaceDetectionResult {
+    static constexpr int MAX_LANDMARKS = 6;
+    enum Landmark { RIGHT_EYE = 0, LEFT_EYE = 1, NOSE_TIP = 2, MOUTH = 3, RIGHT_EAR = 4, LEFT_EAR = 5 };
+
     cv::Rect box;
-    std::vector<cv::Point2f> landmarks;
-    float score;
+    std::array<cv::Point2f, MAX_LANDMARKS> landmarks{};
+    float score = 0.0f;
+    // Valid entries of landmarks, a model may predict fewer than MAX_LANDMARKS
+    int landmark_count = 0;
+
+    const cv::Point2f& landmark(Landmark which) const { return landmarks[which]; }
+    const cv::Point2f& right_eye() const { return landmarks[RIGHT_EYE]; }
+    const cv::Point2f& left_eye() const { return landmarks[LEFT_EYE]; }
+    const cv::Point2f& nose_tip() const { return landmarks[NOSE_TIP]; }
+    const cv::Point2f& mouth() const { return landmarks[MOUTH]; }
+    const cv::Point2f& right_ear() const { return landmarks[RIGHT_EAR]; }
+    const cv::Point2f& left_ear() const { return landmarks[LEFT_EAR]; }
 };
+static_assert(std::is_trivially_copyable<FaceDetectionResult>::value, "FaceDetectionResult must stay trivially copyable");
 
 void draw_detections(const cv::Mat& image, const std::vector<FaceDetectionResult>& detections);
 void debug_aligned_faces(const cv::Mat& image, const FaceDetectionResult& face, const cv::Mat& alignedFace);
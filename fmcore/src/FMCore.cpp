@@ -9,6 +9,16 @@
 #include "face_detection.h"
 #include "face_alignment.h"
 #include "embedding_extraction.h"
+#include "frame.h"
+#include "lazy_model.h"
+#include "model_file.h"
+#include "ort_session.h"
+#include "stage_pipeline.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
 
 #ifdef FMCORE_NATIVE_BUILD
     const bool DEBUG = false;
@@ -17,7 +27,48 @@
 
 using json = nlohmann::json;
 
-static float matchingThresh;
+struct FMCore::Impl {
+    LivenessDetector livenessDetector;
+    FaceDetector faceDetector;
+    // Loaded with faceDetector when "face_detector_short_model" is set
+    FaceDetector shortRangeDetector;
+    std::atomic<bool> hasShortRange{false};
+    float shortRangeMinFace = 0.3f;
+    // Larger side of the previous request's best face over the frame's shorter side, 0 without a face
+    std::atomic<float> lastFaceSize{0.0f};
+    EmbeddingExtractor embeddingExtractor;
+    // Indexed by ModelStage, loaded by init or by the first request that needs them
+    LazyModel models[3];
+    float matchingThresh = 0.0f;
+    size_t asyncQueueDepth = 4;
+    // Set when "parallel_branches" is enabled, runs the embedding branch of WholePipeline
+    std::unique_ptr<ThreadPool> branchPool;
+
+    // Declared last so the stage threads are joined before the models are released
+    std::once_flag pipelineStarted;
+    std::unique_ptr<StagePipeline> pipeline;
+
+    bool detection_stage(PipelineJob& job);
+    bool liveness_stage(PipelineJob& job);
+    bool embedding_stage(PipelineJob& job);
+    StagePipeline& async_pipeline();
+    void run_branches(PipelineJob& job);
+
+    LazyModel& model(ModelStage stage) { return models[static_cast<int>(stage)]; }
+    // Finds the model a config entry names, false if there is none
+    using ModelResolver = std::function<bool(const std::string& name, ModelFile& model)>;
+    bool init(const std::string& configJson, const ModelResolver& resolve, const std::vector<ModelStage>& preload);
+    bool load_models(PipelineMode mode);
+    void detect_faces(const Frame* frames, size_t count, std::vector<FaceDetectionResult>* faces, DetectorRange range);
+    void remember_face_size(const Frame& frame, const std::vector<FaceDetectionResult>& faces);
+    void process_frame(const Frame& frame, PipelineMode mode, DetectorRange range, ProcessResult& result);
+    std::vector<ProcessResult> process_batch(const std::vector<Frame>& frames, PipelineMode mode, DetectorRange range);
+};
+
+FMCore::FMCore() : impl(std::make_unique<Impl>()) {}
+FMCore::~FMCore() = default;
+FMCore::FMCore(FMCore&&) noexcept = default;
+FMCore& FMCore::operator=(FMCore&&) noexcept = default;
 
 
 // TODO include this stuff in a debug build only //////////////////////
@@ -50,7 +101,90 @@ void saveDebugImage(const cv::Mat& img, const std::string& filename) {
 
 // ////////////////////////////////
 
+// Reads the ORT keys present in options into settings, absent keys keep their value.
+// Returns false on an unknown enum value.
+static bool readOrtSettings(const json& options, OrtSettings& settings) {
+    if (options.contains("intra_op_threads") || options.contains("inter_op_threads")) {
+        settings.own_threads = true;
+    }
+    settings.intra_op_threads = options.value("intra_op_threads", settings.intra_op_threads);
+    settings.inter_op_threads = options.value("inter_op_threads", settings.inter_op_threads);
+    settings.allow_spinning = options.value("allow_spinning", settings.allow_spinning);
+    settings.memory_pattern = options.value("memory_pattern", settings.memory_pattern);
+    settings.cpu_arena = options.value("cpu_arena", settings.cpu_arena);
+    settings.arena_max_mem = options.value("arena_max_mem", settings.arena_max_mem);
+
+    if (options.contains("graph_optimization")) {
+        const std::string level = options["graph_optimization"];
+        if (level == "disable") settings.optimization = ORT_DISABLE_ALL;
+        else if (level == "basic") settings.optimization = ORT_ENABLE_BASIC;
+        else if (level == "extended") settings.optimization = ORT_ENABLE_EXTENDED;
+        else if (level == "all") settings.optimization = ORT_ENABLE_ALL;
+        else {
+            std::cerr << "[FMCore] Unknown graph_optimization: " << level << std::endl;
+            return false;
+        }
+    }
+    if (options.contains("execution_mode")) {
+        const std::string mode = options["execution_mode"];
+        if (mode == "sequential") settings.execution_mode = ORT_SEQUENTIAL;
+        else if (mode == "parallel") settings.execution_mode = ORT_PARALLEL;
+        else {
+            std::cerr << "[FMCore] Unknown execution_mode: " << mode << std::endl;
+            return false;
+        }
+    }
+    if (options.contains("arena_extend_strategy")) {
+        const std::string strategy = options["arena_extend_strategy"];
+        if (strategy == "next_power_of_two") settings.arena_extend_strategy = 0;
+        else if (strategy == "same_as_requested") settings.arena_extend_strategy = 1;
+        else {
+            std::cerr << "[FMCore] Unknown arena_extend_strategy: " << strategy << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the "input_size", "mean" and "std" keys of a model section, absent keys keep their value.
+// Tensor values are (pixel - mean) / std. Returns false on a non-positive size or std.
+static bool readImageOptions(const json& options, const char* model, int& inputSize, TensorNorm& norm) {
+    inputSize = options.value("input_size", inputSize);
+    norm.mean = options.value("mean", norm.mean);
+    const float stdDev = options.value("std", 1.0f / norm.scale);
+    if (inputSize <= 0 || stdDev <= 0.0f) {
+        std::cerr << "[FMCore] Invalid input_size or std for " << model << std::endl;
+        return false;
+    }
+    norm.scale = 1.0f / stdDev;
+    return true;
+}
+
 bool FMCore::init(const std::string& configJson, const std::string& modelBasePath) {
+    return init(configJson, modelBasePath, {ModelStage::Detection, ModelStage::Liveness, ModelStage::Embedding});
+}
+
+bool FMCore::init(const std::string& configJson, const std::string& modelBasePath, const std::vector<ModelStage>& preload) {
+    return impl->init(configJson, [&](const std::string& name, ModelFile& model) {
+        model = ModelFile(joinPath(modelBasePath, name));
+        return true;
+    }, preload);
+}
+
+bool FMCore::init(const std::string& configJson, const std::map<std::string, ModelSource>& models,
+                  const std::vector<ModelStage>& preload) {
+    return impl->init(configJson, [&](const std::string& name, ModelFile& model) {
+        auto source = models.find(name);
+        if (source == models.end()) {
+            std::cerr << "[FMCore] No model source for " << name << std::endl;
+            return false;
+        }
+        model = ModelFile(name, source->second);
+        return true;
+    }, preload);
+}
+
+bool FMCore::Impl::init(const std::string& configJson, const ModelResolver& resolve, const std::vector<ModelStage>& preload) {
     std::cout << "[FMCore] Initialized with config: " << configJson << std::endl;
     
     // Parse configuration
@@ -63,7 +197,8 @@ bool FMCore::init(const std::string& configJson, const std::string& modelBasePat
     }
 
     // Extract model names
-    if (!config.contains("liveness_model0") || !config.contains("liveness_model1")) {
+    const bool livenessEnsemble = config.contains("liveness_ensemble_model");
+    if (!livenessEnsemble && (!config.contains("liveness_model0") || !config.contains("liveness_model1"))) {
         std::cerr << "[FMCore] Missing liveness model in config." << std::endl;
         return false;
     }
@@ -76,54 +211,443 @@ bool FMCore::init(const std::string& configJson, const std::string& modelBasePat
         return false;
     }
 
-    const std::string livenessModel0 = config["liveness_model0"];
-    const std::string livenessModel1 = config["liveness_model1"];
     const std::string faceModel = config["face_detector_model"];
+    const std::string shortFaceModel = config.value("face_detector_short_model", std::string());
     const std::string embModel = config["embedding_extractor_model"];
     const float livenessThresh = config["liveness_threshold"];
     matchingThresh = config["matching_threshold"];
+    asyncQueueDepth = config.value("async_queue_depth", asyncQueueDepth);
+    if (!config.value("parallel_branches", false)) {
+        branchPool.reset();
+    } else if (!branchPool) {
+        branchPool = std::make_unique<ThreadPool>(2);
+    }
 
-    std::string livenessModel0Path = joinPath(modelBasePath, livenessModel0);
-    std::string livenessModel1Path = joinPath(modelBasePath, livenessModel1);
-    std::vector<std::string> livenessModelPaths;
-    livenessModelPaths.push_back(livenessModel0Path);
-    livenessModelPaths.push_back(livenessModel1Path);
-    std::string faceModelPath = joinPath(modelBasePath, faceModel);
-    std::string embModelPath = joinPath(modelBasePath, embModel);
+    // A fused ensemble (see tools/merge_liveness.py) replaces the two separate liveness models
+    std::vector<std::string> livenessModelNames;
+    if (livenessEnsemble) {
+        livenessModelNames.push_back(config["liveness_ensemble_model"]);
+    } else {
+        livenessModelNames.push_back(config["liveness_model0"]);
+        livenessModelNames.push_back(config["liveness_model1"]);
+    }
+    const bool parallelLiveness = config.value("parallel_liveness", false);
+    std::vector<ModelFile> livenessModels(livenessModelNames.size());
+    ModelFile faceModelFile, shortFaceModelFile, embModelFile;
+    for (size_t i = 0; i < livenessModelNames.size(); ++i) {
+        if (!resolve(livenessModelNames[i], livenessModels[i])) return false;
+    }
+    if (!resolve(faceModel, faceModelFile) || !resolve(embModel, embModelFile) ||
+        (!shortFaceModel.empty() && !resolve(shortFaceModel, shortFaceModelFile))) {
+        return false;
+    }
     
     
-    std::cout << "[FMCore] Liveness model0 path: " << livenessModel0Path << std::endl;
-    std::cout << "[FMCore] Liveness model1 path: " << livenessModel1Path << std::endl;
-    std::cout << "[FMCore] Face detector model path: " << faceModelPath << std::endl;
-    std::cout << "[FMCore] Embedding extractor model path: " << embModelPath << std::endl;
+    for (size_t i = 0; i < livenessModels.size(); ++i) {
+        std::cout << "[FMCore] Liveness model" << i << " path: " << livenessModels[i].name() << std::endl;
+    }
+    std::cout << "[FMCore] Face detector model path: " << faceModelFile.name() << std::endl;
+    if (!shortFaceModel.empty()) {
+        std::cout << "[FMCore] Short-range face detector model path: " << shortFaceModelFile.name() << std::endl;
+    }
+    std::cout << "[FMCore] Embedding extractor model path: " << embModelFile.name() << std::endl;
     
-    Ort::SessionOptions ort_session_options;
-    ort_session_options.SetIntraOpNumThreads(1);
-    ort_session_options.SetGraphOptimizationLevel(ORT_ENABLE_BASIC);
+    // All models share one environment: global thread pools and a single CPU arena.
+    // "ort_options" tunes them and every session, "ort_options.<model>" overrides one model.
+    const json ortOptions = config.value("ort_options", json::object());
+    OrtSettings ortGlobal;
+    if (!readOrtSettings(ortOptions, ortGlobal)) {
+        return false;
+    }
+    if (!configure_ort_env(ortGlobal)) {
+        std::cerr << "[FMCore] ONNX Runtime environment already configured by an earlier init with other "
+                     "ort_options, keeping its thread and arena settings." << std::endl;
+    }
+    ortGlobal.own_threads = false;
+    ortGlobal.model_cache = config.value("model_cache", false);
+    ortGlobal.model_cache_dir = config.value("model_cache_dir", std::string());
+    auto modelSettings = [&](const char* model, OrtSettings& settings) {
+        settings = ortGlobal;
+        return !ortOptions.contains(model) || readOrtSettings(ortOptions[model], settings);
+    };
+    OrtSettings livenessSettings, faceSettings, embeddingSettings;
+    if (!modelSettings("liveness", livenessSettings) ||
+        !modelSettings("face_detector", faceSettings) ||
+        !modelSettings("embedding_extractor", embeddingSettings)) {
+        return false;
+    }
     
-    bool res_ld = init_liveness_detector(ort_session_options, livenessModelPaths, livenessThresh);
-    if (!res_ld) {
-        std::cerr << "[FMCore] Failed to init liveness detector" << std::endl;
+    // Geometry and normalization of the model inputs, for variants the defaults don't describe.
+    // Input sizes only apply where a model leaves them symbolic.
+    const json detectorConfig = config.value("face_detector", json::object());
+    const json shortDetectorConfig = config.value("face_detector_short", json::object());
+    const json livenessConfig = config.value("liveness", json::object());
+    const json embeddingConfig = config.value("embedding_extractor", json::object());
+    FaceDetectorOptions detectorOptions, shortDetectorOptions;
+    shortDetectorOptions.input_size = 128;
+    LivenessOptions livenessOptions;
+    EmbeddingOptions embeddingOptions;
+    if (!readImageOptions(detectorConfig, "face_detector", detectorOptions.input_size, detectorOptions.norm) ||
+        !readImageOptions(shortDetectorConfig, "face_detector_short", shortDetectorOptions.input_size,
+                          shortDetectorOptions.norm) ||
+        !readImageOptions(livenessConfig, "liveness", livenessOptions.input_size, livenessOptions.norm) ||
+        !readImageOptions(embeddingConfig, "embedding_extractor", embeddingOptions.input_size, embeddingOptions.norm)) {
+        return false;
+    }
+    // The pipeline only uses the best face, so the other candidates aren't decoded unless asked for
+    for (auto [section, options] : {std::make_pair(&detectorConfig, &detectorOptions),
+                                    std::make_pair(&shortDetectorConfig, &shortDetectorOptions)}) {
+        options->best_face_only = section->value("best_face_only", true);
+        options->blend_boxes = section->value("blend_boxes", false);
+    }
+    livenessOptions.crop_scales = livenessConfig.value("crop_scales", livenessOptions.crop_scales);
+    livenessOptions.real_class = livenessConfig.value("real_class", livenessOptions.real_class);
+    if (!livenessEnsemble && livenessOptions.crop_scales.size() != livenessModels.size()) {
+        std::cerr << "[FMCore] liveness.crop_scales needs one scale per liveness model." << std::endl;
+        return false;
     }
+    
+    // Models outside preload are only checked for presence here, their sessions are created on first use
+    model(ModelStage::Liveness).configure(
+        [this, livenessSettings, livenessModels, livenessThresh, livenessOptions, parallelLiveness]() {
+            bool res_ld = livenessDetector.init(livenessSettings, livenessModels, livenessThresh, livenessOptions,
+                                                parallelLiveness);
+            if (!res_ld) {
+                std::cerr << "[FMCore] Failed to init liveness detector" << std::endl;
+            }
+            return res_ld;
+        },
+        [this]() { livenessDetector.release(); });
     // Mediapipe onnx face detection model are from https://github.com/Tensor46/mpface
-//    bool success = init_face_detector("../../models/mediapipe_short.onnx", /* short_range= */ true);
-    bool res_fd = init_face_detector(ort_session_options, faceModelPath, /* short_range= */ false);
-    if (!res_fd) {
-        std::cout << "[FMCore] Failed to init face detector" << std::endl;
+    // The short-range detector is part of the detection stage, it is loaded and released with the long-range one
+    shortRangeMinFace = shortDetectorConfig.value("min_face_size", shortRangeMinFace);
+    lastFaceSize = 0.0f;
+    model(ModelStage::Detection).configure(
+        [this, faceSettings, faceModelFile, detectorOptions, shortFaceModelFile, shortDetectorOptions]() {
+            bool res_fd = faceDetector.init(faceSettings, faceModelFile, detectorOptions);
+            if (!res_fd) {
+                std::cout << "[FMCore] Failed to init face detector" << std::endl;
+            }
+            hasShortRange = false;
+            if (res_fd && !shortFaceModelFile.name().empty()) {
+                res_fd = shortRangeDetector.init(faceSettings, shortFaceModelFile, shortDetectorOptions);
+                if (!res_fd) {
+                    std::cout << "[FMCore] Failed to init short-range face detector" << std::endl;
+                }
+                hasShortRange = res_fd;
+            }
+            return res_fd;
+        },
+        [this]() {
+            faceDetector.release();
+            shortRangeDetector.release();
+            hasShortRange = false;
+        });
+    model(ModelStage::Embedding).configure(
+        [this, embeddingSettings, embModelFile, embeddingOptions]() {
+            bool res_emb_ex = embeddingExtractor.init(embeddingSettings, embModelFile, embeddingOptions);
+            if (!res_emb_ex) {
+                std::cout << "[FMCore] Failed to init embedding extractor" << std::endl;
+            }
+            return res_emb_ex;
+        },
+        [this]() { embeddingExtractor.release(); });
+
+    // Preloaded models are built concurrently, each one blocks on ORT parsing and optimization.
+    // Every one of them is attempted even if another fails.
+    const std::vector<std::pair<ModelStage, std::vector<ModelFile>>> stageModels = {
+        {ModelStage::Liveness, livenessModels},
+        {ModelStage::Detection, shortFaceModel.empty() ? std::vector<ModelFile>{faceModelFile}
+                                                       : std::vector<ModelFile>{faceModelFile, shortFaceModelFile}},
+        {ModelStage::Embedding, {embModelFile}}
+    };
+    ThreadPool loaders(preload.empty() ? 1 : preload.size());
+    std::vector<std::future<bool>> loading;
+    bool res = true;
+    for (const auto& [stage, files] : stageModels) {
+        if (std::find(preload.begin(), preload.end(), stage) != preload.end()) {
+            LazyModel& lazy = model(stage);
+            loading.push_back(loaders.submit([&lazy]() { return lazy.ensure_loaded(); }));
+            continue;
+        }
+        for (const ModelFile& file : files) {
+            if (!file.available()) {
+                std::cerr << "[FMCore] Model not found: " << file.name() << std::endl;
+                res = false;
+            }
+        }
+    }
+    for (auto& loaded : loading) {
+        res = loaded.get() && res;
+    }
+
+    return res;
+}
+
+std::future<bool> FMCore::initAsync(const std::string& configJson, const std::string& modelBasePath,
+                                    const std::vector<ModelStage>& preload) {
+    return std::async(std::launch::async, [this, configJson, modelBasePath, preload]() {
+        return init(configJson, modelBasePath, preload);
+    });
+}
+
+void FMCore::unload(ModelStage stage) {
+    impl->model(stage).unload();
+}
+
+// Loads the models a mode runs through, detection is always needed
+bool FMCore::Impl::load_models(PipelineMode mode) {
+    bool loaded = model(ModelStage::Detection).ensure_loaded();
+    if (mode != PipelineMode::SkipLiveness) {
+        loaded = model(ModelStage::Liveness).ensure_loaded() && loaded;
+    }
+    if (mode != PipelineMode::OnlyLiveness) {
+        loaded = model(ModelStage::Embedding).ensure_loaded() && loaded;
+    }
+    if (!loaded) {
+        std::cerr << "[FMCore] Models for this mode are not available." << std::endl;
+    }
+    return loaded;
+}
+
+
+// Runs the detector range asks for, faces[i] receives the faces of frames[i]. In Auto, the short-range
+// detector is used while the previous request's face was large enough, and frames where it finds nothing
+// are detected again with the long-range one (the face may have moved away).
+void FMCore::Impl::detect_faces(const Frame* frames, size_t count, std::vector<FaceDetectionResult>* faces,
+                                DetectorRange range) {
+    if (count == 0) return;
+    bool useShort = false;
+    if (hasShortRange) {
+        useShort = range == DetectorRange::Short ||
+                   (range == DetectorRange::Auto && lastFaceSize.load() >= shortRangeMinFace);
+    }
+    if (!useShort) {
+        faceDetector.detect_faces(frames, count, faces);
+    } else {
+        shortRangeDetector.detect_faces(frames, count, faces);
+        for (size_t i = 0; range == DetectorRange::Auto && i < count; ++i) {
+            if (!faces[i].empty()) continue;
+            faceDetector.detect_faces(&frames[i], 1, &faces[i]);
+        }
+    }
+    if (range == DetectorRange::Auto) remember_face_size(frames[count - 1], faces[count - 1]);
+}
+
+// Keeps the relative size of the last frame's best face for the next Auto selection
+void FMCore::Impl::remember_face_size(const Frame& frame, const std::vector<FaceDetectionResult>& faces) {
+    float size = 0.0f;
+    if (!faces.empty()) {
+        const cv::Rect& box = faces.front().box;
+        size = static_cast<float>(std::max(box.width, box.height)) / std::min(frame.width, frame.height);
+    }
+    lastFaceSize = size;
+}
+
+// Pipeline stages, each returns false when the request is complete.
+// Stages only convert the pixels they sample, so YUV frames are never converted whole.
+bool FMCore::Impl::detection_stage(PipelineJob& job) {
+    const Frame& frame = job.frame;
+    std::cout << "[FMCore] Image size: " << frame.width << "x" << frame.height << std::endl;
+
+    // Step 1: Face detection
+    detect_faces(&frame, 1, &job.faces, job.range);
+    if (job.faces.empty()) {
+        std::cout << "[FMCore] No faces detected." << std::endl;
+        return false;
+    }
+
+    job.result.faceDetected = true;
+    std::cout << "[FMCore] Detected " << job.faces.size() << " face(s)." << std::endl;
+    return true;
+}
+
+bool FMCore::Impl::liveness_stage(PipelineJob& job) {
+    // Step 2: Liveness
+    if (job.mode == PipelineMode::OnlyLiveness || job.mode == PipelineMode::WholePipeline) {
+        job.result.livenessChecked = true;
+        LivenessResult resLiveness = livenessDetector.run_liveness_check(job.frame, job.faces[0]);
+        job.result.isLive = resLiveness.isLive;
+        job.result.livenessScore = resLiveness.score;
+        if (!job.result.isLive) {
+            std::cout << "[FMCore] Liveness check failed. [SPOOF]" << std::endl;
+            return false;
+        }
+        std::cout << "[FMCore] Liveness check passed. [LIVE]" << std::endl;
+    }
+
+    return job.mode != PipelineMode::OnlyLiveness;
+}
+
+bool FMCore::Impl::embedding_stage(PipelineJob& job) {
+    // Step 3: Align and extract embedding, the warp writes straight into the model input
+#ifdef FMCORE_NATIVE_BUILD
+    if(DEBUG) {
+        cv::Mat bgr = frame_to_bgr(job.frame);
+        cv::Mat alignedFace = align_face(bgr, job.faces[0]);
+        debug_aligned_faces(bgr, job.faces[0], alignedFace);
     }
+#endif
     
-    bool res_emb_ex = init_embedding_extractor(ort_session_options, embModelPath);
-    if (!res_emb_ex) {
-        std::cout << "[FMCore] Failed to init embedding extractor" << std::endl;
+//    saveDebugImage(align_face(frame_to_bgr(job.frame), job.faces[0]), "alignedFace.png");
+
+    embeddingExtractor.extract_embedding(&job.frame, &job.faces[0], 1, &job.result.embedding);
+    job.result.embeddingExtracted = !job.result.embedding.empty();
+    return true;
+}
+
+// Runs the stages in order on the calling thread, shared by the file and the in-memory entry points.
+// The job is kept per thread so its face list keeps its storage, and result's embedding storage is
+// moved through it: a warmed-up request doesn't allocate on our side.
+void FMCore::Impl::process_frame(const Frame& frame, PipelineMode mode, DetectorRange range,
+                                 ProcessResult& result) {
+    std::vector<float> embedding = std::move(result.embedding);
+    embedding.clear();
+    result = ProcessResult();
+    result.embedding = std::move(embedding);
+    if (!load_models(mode)) {
+        return;
+    }
+
+    thread_local PipelineJob job;
+    job.frame = frame;
+    job.mode = mode;
+    job.range = range;
+    job.result = std::move(result);
+
+    if (detection_stage(job)) {
+        if (mode == PipelineMode::WholePipeline && branchPool) {
+            run_branches(job);
+        } else if (liveness_stage(job)) {
+            embedding_stage(job);
+        }
+    }
+    result = std::move(job.result);
+}
+
+// After detection both branches only need the frame and faces[0]: liveness runs on the calling
+// thread while alignment and embedding run on the pool. A spoof terminates the embedding Run.
+void FMCore::Impl::run_branches(PipelineJob& job) {
+    Ort::RunOptions embeddingRun;
+    std::atomic<bool> cancelled(false);
+
+    // The branch writes the embedding only, liveness_stage the liveness fields of the result
+    std::future<void> embedding = branchPool->submit([&]() {
+        if (cancelled) return;
+        try {
+            embeddingExtractor.extract_embedding(&job.frame, &job.faces[0], 1, &job.result.embedding,
+                                                 embeddingRun);
+        } catch (const Ort::Exception& e) {
+            if (!cancelled) {
+                std::cerr << "[FMCore] Embedding extraction failed: " << e.what() << std::endl;
+            }
+            job.result.embedding.clear();
+        }
+    });
+
+    bool live = false;
+    try {
+        live = liveness_stage(job);
+    } catch (...) {
+        // The branch references this frame, it has to finish before unwinding
+        cancelled = true;
+        embeddingRun.SetTerminate();
+        embedding.wait();
+        throw;
+    }
+
+    if (!live) {
+        cancelled = true;
+        embeddingRun.SetTerminate();
+        embedding.wait();
+        // The Run may have completed before the terminate
+        job.result.embedding.clear();
+        return;
     }
 
-    return res_ld && res_fd && res_emb_ex;
+    embedding.get();
+    job.result.embeddingExtracted = !job.result.embedding.empty();
 }
 
+// Started on the first processAsync() so synchronous users never spawn threads.
+StagePipeline& FMCore::Impl::async_pipeline() {
+    std::call_once(pipelineStarted, [this]() {
+        std::vector<StagePipeline::Stage> stages = {
+            [this](PipelineJob& job) { return detection_stage(job); },
+            [this](PipelineJob& job) { return liveness_stage(job); },
+            [this](PipelineJob& job) { return embedding_stage(job); }
+        };
+        pipeline = std::make_unique<StagePipeline>(std::move(stages), asyncQueueDepth);
+    });
+    return *pipeline;
+}
+
+// Same stages as process_frame, but every stage runs once for all frames that reached it.
+std::vector<ProcessResult> FMCore::Impl::process_batch(const std::vector<Frame>& frames, PipelineMode mode,
+                                                       DetectorRange range) {
+    std::vector<ProcessResult> results(frames.size());
+    if (!load_models(mode)) {
+        return results;
+    }
+
+    // Step 1: Face detection
+    std::vector<std::vector<FaceDetectionResult>> faces(frames.size());
+    detect_faces(frames.data(), frames.size(), faces.data(), range);
+
+    // Frames with a face continue with their best face
+    std::vector<size_t> active;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (faces[i].empty()) continue;
+        results[i].faceDetected = true;
+        active.push_back(i);
+    }
+    std::cout << "[FMCore] Detected faces in " << active.size() << "/" << frames.size() << " frame(s)." << std::endl;
+
+    // Step 2: Liveness
+    if (mode == PipelineMode::OnlyLiveness || mode == PipelineMode::WholePipeline) {
+        std::vector<Frame> liveFrames;
+        std::vector<FaceDetectionResult> liveFaces;
+        for (size_t i : active) {
+            liveFrames.push_back(frames[i]);
+            liveFaces.push_back(faces[i][0]);
+        }
+        std::vector<LivenessResult> resLiveness = livenessDetector.run_liveness_check(liveFrames, liveFaces);
+
+        std::vector<size_t> live;
+        for (size_t k = 0; k < active.size(); ++k) {
+            ProcessResult& result = results[active[k]];
+            result.livenessChecked = true;
+            result.isLive = resLiveness[k].isLive;
+            result.livenessScore = resLiveness[k].score;
+            if (result.isLive) live.push_back(active[k]);
+        }
+        std::cout << "[FMCore] Liveness passed for " << live.size() << "/" << active.size() << " frame(s)." << std::endl;
+        active = live;
+    }
+
+    if (mode == PipelineMode::OnlyLiveness || active.empty()) {
+        return results;
+    }
+
+    // Step 3: Align and extract embeddings
+    std::vector<Frame> embeddingFrames;
+    std::vector<FaceDetectionResult> embeddingFaces;
+    for (size_t i : active) {
+        embeddingFrames.push_back(frames[i]);
+        embeddingFaces.push_back(faces[i][0]);
+    }
+    std::vector<std::vector<float>> embeddings = embeddingExtractor.extract_embedding(embeddingFrames, embeddingFaces);
+    for (size_t k = 0; k < active.size(); ++k) {
+        ProcessResult& result = results[active[k]];
+        result.embedding = std::move(embeddings[k]);
+        result.embeddingExtracted = !result.embedding.empty();
+    }
 
-ProcessResult FMCore::process(const std::string& imagePath, PipelineMode mode) {
+    return results;
+}
+
+ProcessResult FMCore::process(const std::string& imagePath, PipelineMode mode, DetectorRange range) {
     std::cout << "[FMCore] Processing image: " << imagePath << std::endl;
-    ProcessResult result;
 
     // Load image
     cv::Mat image = cv::imread(imagePath, cv::IMREAD_COLOR);
@@ -132,74 +656,128 @@ ProcessResult FMCore::process(const std::string& imagePath, PipelineMode mode) {
     
     if (image.empty()) {
         std::cerr << "[FMCore] Failed to load image at: " << imagePath << std::endl;
-        return result;
+        return ProcessResult();
     }
 
-    std::cout << "[FMCore] Image size: " << image.cols << "x" << image.rows << std::endl;
+    ProcessResult result;
+    impl->process_frame(frame_from_mat(image), mode, range, result);
+    return result;
+}
 
-    
-    // Step 1: Face detection
-    std::vector<FaceDetectionResult> faces = detect_faces(image);
-    if (faces.empty()) {
-        std::cout << "[FMCore] No faces detected." << std::endl;
-        return result;
+ProcessResult FMCore::process(const Frame& frame, PipelineMode mode, DetectorRange range) {
+    ProcessResult result;
+    process(frame, mode, result, range);
+    return result;
+}
+
+void FMCore::process(const Frame& frame, PipelineMode mode, ProcessResult& result, DetectorRange range) {
+    std::cout << "[FMCore] Processing frame: " << frame.width << "x" << frame.height
+              << " format " << static_cast<int>(frame.format) << std::endl;
+
+    if (!validate_frame(frame)) {
+        std::cerr << "[FMCore] Invalid frame." << std::endl;
+        result = ProcessResult();
+        return;
     }
 
-    result.faceDetected = true;
-    std::cout << "[FMCore] Detected " << faces.size() << " face(s)." << std::endl;
-    
-    // Step 2: Liveness
-    if (mode == PipelineMode::OnlyLiveness || mode == PipelineMode::WholePipeline) {
-        result.livenessChecked = true;
-        LivenessResult resLiveness = run_liveness_check(image, faces[0]);
-        result.isLive = resLiveness.isLive;
-        result.livenessScore = resLiveness.score;
-        if (!result.isLive) {
-            std::cout << "[FMCore] Liveness check failed. [SPOOF]" << std::endl;
-            return result;
+    impl->process_frame(frame, mode, range, result);
+}
+
+ProcessResult FMCore::process(const uint8_t* data, int width, int height, int stride, PixelFormat format, PipelineMode mode,
+                              DetectorRange range) {
+    return process(makeFrame(data, width, height, stride, format), mode, range);
+}
+
+
+std::vector<ProcessResult> FMCore::processBatch(const std::vector<Frame>& frames, PipelineMode mode, DetectorRange range) {
+    std::cout << "[FMCore] Processing batch of " << frames.size() << " frame(s)" << std::endl;
+
+    // Invalid frames get an empty result, the others are processed together
+    std::vector<ProcessResult> results(frames.size());
+    std::vector<Frame> validFrames;
+    std::vector<size_t> validIndices;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        if (!validate_frame(frames[i])) {
+            std::cerr << "[FMCore] Invalid frame at index " << i << "." << std::endl;
+            continue;
         }
-        std::cout << "[FMCore] Liveness check passed. [LIVE]" << std::endl;
+        validFrames.push_back(frames[i]);
+        validIndices.push_back(i);
     }
+    if (validFrames.empty()) return results;
 
-    if (mode == PipelineMode::OnlyLiveness) {
-        return result;
+    std::vector<ProcessResult> batchResults = impl->process_batch(validFrames, mode, range);
+    for (size_t k = 0; k < validIndices.size(); ++k) {
+        results[validIndices[k]] = std::move(batchResults[k]);
     }
+    return results;
+}
 
-    // Step 3: Align and extract embedding
-    cv::Mat alignedFace = align_face(image, faces[0]);
+std::future<ProcessResult> FMCore::processAsync(const Frame& frame, PipelineMode mode, DetectorRange range) {
+    auto promise = std::make_shared<std::promise<ProcessResult>>();
+    std::future<ProcessResult> future = promise->get_future();
+    processAsync(frame, mode, [promise](ProcessResult result) {
+        promise->set_value(std::move(result));
+    }, range);
+    return future;
+}
 
-#ifdef FMCORE_NATIVE_BUILD
-    if(DEBUG) {
-        debug_aligned_faces(image, faces[0], alignedFace);
+void FMCore::processAsync(const Frame& frame, PipelineMode mode, std::function<void(ProcessResult)> callback,
+                          DetectorRange range) {
+    if (!validate_frame(frame)) {
+        std::cerr << "[FMCore] Invalid frame." << std::endl;
+        callback(ProcessResult());
+        return;
     }
-#endif
-    
-//    saveDebugImage(alignedFace, "alignedFace.png");
 
-    result.embedding = extract_embedding(alignedFace);
-    result.embeddingExtracted = !result.embedding.empty();
+    // Loading happens here on the caller, not on a stage thread shared with other requests
+    if (!impl->load_models(mode)) {
+        callback(ProcessResult());
+        return;
+    }
 
-    return result;
+    auto job = std::make_unique<PipelineJob>();
+    job->frame = frame;
+    job->mode = mode;
+    job->range = range;
+    job->done = std::move(callback);
+    // Only fails while the FMCore is being destroyed, the callback then gets an empty result
+    if (!impl->async_pipeline().submit(std::move(job))) {
+        std::cerr << "[FMCore] Async pipeline is shutting down." << std::endl;
+    }
 }
 
 
 bool FMCore::match(const std::vector<float>& embedding1, const std::vector<float>& embedding2) {
+    if (embedding1.size() != embedding2.size()) return 0.0f;
+
+    return match(embedding1.data(), embedding2.data(), embedding1.size());
+}
+
+bool FMCore::match(const float* embedding1, const float* embedding2, size_t size) {
     std::cout << "[FMCore] Matching embeddings..." << std::endl;
 
-    if (embedding1.size() != embedding2.size()) return 0.0f;
+    if (size == 0) return false;
+
+    float score = similarity(embedding1, embedding2, size);
+    
+    std::cout << "[FMCore] Matching score: " << score << std::endl;
+
+    return isMatch(score);
+}
 
+float FMCore::similarity(const float* embedding1, const float* embedding2, size_t size) const {
     float dot = 0.0f, norm1 = 0.0f, norm2 = 0.0f;
-    for (size_t i = 0; i < embedding1.size(); ++i) {
+    for (size_t i = 0; i < size; ++i) {
         dot += embedding1[i] * embedding2[i];
         norm1 += embedding1[i] * embedding1[i];
         norm2 += embedding2[i] * embedding2[i];
     }
-    
-    float score = dot / (std::sqrt(norm1) * std::sqrt(norm2) + 1e-6f);
-    
-    std::cout << "[FMCore] Matching score: " << score << std::endl;
+    return dot / (std::sqrt(norm1) * std::sqrt(norm2) + 1e-6f);
+}
 
-    return score >= matchingThresh;
+bool FMCore::isMatch(float similarity) const {
+    return similarity >= impl->matchingThresh;
 }
 
 void FMCore::reset() {
@@ -1,37 +1,33 @@
 #include "embedding_extraction.h"
+#include "ort_session.h"
+#include "face_alignment.h"
+#include "frame.h"
+#include "tensor_kernels.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <numeric>
-#include <mutex>
+#include <shared_mutex>
 #include <iostream>
 
-namespace {
-
-Ort::Env& getOrtEnv() {
-    static Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "Embedding");
-    return env;
-}
-
-std::unique_ptr<Ort::Session> embedding_session;
-std::mutex embedding_mutex;
-
-int embedding_input_size = 112;
-float input_mean = 127.5f;
-float input_std = 127.5f;
-
-}  // namespace
-
-bool init_embedding_extractor(Ort::SessionOptions& options, const std::string& model_path) {
+bool EmbeddingExtractor::init(const OrtSettings& settings, const ModelFile& model, const EmbeddingOptions& options) {
     try {
-        std::lock_guard<std::mutex> lock(embedding_mutex);
-        embedding_session = std::make_unique<Ort::Session>(getOrtEnv(), model_path.c_str(), options);
-        std::cout << "[Embedding] Loaded model: " << model_path << std::endl;
-
-//        Ort::AllocatorWithDefaultOptions allocator;
-//        size_t count = embedding_session->GetOutputCount();
-//        for (size_t i = 0; i < count; ++i) {
-//            auto name = embedding_session->GetOutputNameAllocated(i, allocator);
-//            std::cout << "[Embedding] Output[" << i << "] name: " << name.get() << std::endl;
+        std::lock_guard<std::shared_mutex> lock(embedding_mutex);
+        embedding_model = std::make_unique<ModelSession>(create_session(model, settings));
+        // Faces are aligned onto a square crop, the landmark template scales with its side
+        int height = 0, width = 0;
+        if (embedding_model->io().output_names.empty() ||
+            !embedding_model->resolve_image_input(0, options.input_size, height, width) || height != width) {
+            std::cerr << "[Embedding] Expected one square image input: " << model.name() << std::endl;
+            embedding_model.reset();
+            return false;
+        }
+        embedding_input_size = height;
+        input_norm = options.norm;
+        std::cout << "[Embedding] Loaded model: " << model.name() << " (" << embedding_input_size << "px"
+                  << (embedding_model->dynamic_batch() ? ", batched" : "") << ")" << std::endl;
+
+//        for (const auto& name : embedding_model->io().output_names) {
+//            std::cout << "[Embedding] Output name: " << name << std::endl;
 //        }
         return true;
     } catch (const Ort::Exception& e) {
@@ -40,46 +36,97 @@ bool init_embedding_extractor(Ort::SessionOptions& options, const std::string& m
     }
 }
 
-std::vector<float> extract_embedding(const cv::Mat& aligned_face) {
-    std::lock_guard<std::mutex> lock(embedding_mutex);
-
-    cv::Mat input;
-    cv::resize(aligned_face, input, cv::Size(embedding_input_size, embedding_input_size));
-    input.convertTo(input, CV_32FC3);
-    cv::cvtColor(input, input, cv::COLOR_BGR2RGB);
-    input = (input - input_mean) / input_std;
-
-    std::vector<float> input_tensor_values(3 * embedding_input_size * embedding_input_size);
-    std::vector<cv::Mat> channels(3);
-    for (int i = 0; i < 3; ++i)
-        channels[i] = cv::Mat(embedding_input_size, embedding_input_size, CV_32F, input_tensor_values.data() + i * embedding_input_size * embedding_input_size);
-    cv::split(input, channels);  // HWC -> CHW
-
-    std::vector<int64_t> input_shape = {1, 3, embedding_input_size, embedding_input_size};
-    Ort::MemoryInfo mem_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
-        mem_info, input_tensor_values.data(), input_tensor_values.size(),
-        input_shape.data(), input_shape.size()
-    );
+std::vector<float> EmbeddingExtractor::extract_embedding(const cv::Mat& aligned_face, const Ort::RunOptions& run_options) {
+    std::vector<float> embedding;
+    const cv::Size size(embedding_input_size, embedding_input_size);
+    run_batch(1, [&](size_t, float* dst) {
+        if (aligned_face.empty()) return false;
+        Frame frame = frame_from_mat(aligned_face);
+        return resize_to_tensor(frame, cv::Rect(0, 0, frame.width, frame.height), size, size, input_norm, dst);
+    }, &embedding, run_options);
+    return embedding;
+}
 
-    Ort::AllocatorWithDefaultOptions allocator;
-    auto input_name_holder = embedding_session->GetInputNameAllocated(0, allocator);
-    auto output_name_holder = embedding_session->GetOutputNameAllocated(0, allocator);
+std::vector<std::vector<float>> EmbeddingExtractor::extract_embedding(const std::vector<cv::Mat>& aligned_faces,
+                                                                      const Ort::RunOptions& run_options) {
+    std::vector<std::vector<float>> embeddings(aligned_faces.size());
+    const cv::Size size(embedding_input_size, embedding_input_size);
+    run_batch(aligned_faces.size(), [&](size_t n, float* dst) {
+        if (aligned_faces[n].empty()) return false;
+        Frame frame = frame_from_mat(aligned_faces[n]);
+        return resize_to_tensor(frame, cv::Rect(0, 0, frame.width, frame.height), size, size, input_norm, dst);
+    }, embeddings.data(), run_options);
+    return embeddings;
+}
 
-    const char* input_name = input_name_holder.get();
-    const char* output_name = output_name_holder.get();
+std::vector<float> EmbeddingExtractor::extract_embedding(const Frame& frame, const FaceDetectionResult& face,
+                                                         const Ort::RunOptions& run_options) {
+    std::vector<float> embedding;
+    extract_embedding(&frame, &face, 1, &embedding, run_options);
+    return embedding;
+}
 
-    auto output_tensors = embedding_session->Run(Ort::RunOptions{nullptr},
-                                                 &input_name, &input_tensor, 1,
-                                                 &output_name, 1);
-    float* output_data = output_tensors[0].GetTensorMutableData<float>();
-    size_t dim = output_tensors[0].GetTensorTypeAndShapeInfo().GetShape()[1];
+std::vector<std::vector<float>> EmbeddingExtractor::extract_embedding(const std::vector<Frame>& frames,
+                                                                      const std::vector<FaceDetectionResult>& faces,
+                                                                      const Ort::RunOptions& run_options) {
+    std::vector<std::vector<float>> embeddings(faces.size());
+    if (frames.size() != faces.size()) {
+        std::cerr << "[Embedding] " << frames.size() << " frames for " << faces.size() << " faces" << std::endl;
+        return embeddings;
+    }
+    extract_embedding(frames.data(), faces.data(), faces.size(), embeddings.data(), run_options);
+    return embeddings;
+}
 
-    std::vector<float> embedding(output_data, output_data + dim);
+void EmbeddingExtractor::extract_embedding(const Frame* frames, const FaceDetectionResult* faces, size_t count,
+                                           std::vector<float>* embeddings, const Ort::RunOptions& run_options) {
+    run_batch(count, [&](size_t n, float* dst) {
+        return align_face_to_tensor(frames[n], faces[n], embedding_input_size, input_norm, dst);
+    }, embeddings, run_options);
+}
 
-    // L2 normalize
-    float norm = std::sqrt(std::inner_product(embedding.begin(), embedding.end(), embedding.begin(), 0.0f));
-    for (auto& val : embedding) val /= norm;
+template <typename Fill>
+void EmbeddingExtractor::run_batch(size_t count, const Fill& fill, std::vector<float>* embeddings,
+                                   const Ort::RunOptions& run_options) {
+    for (size_t n = 0; n < count; ++n) {
+        embeddings[n].clear();
+    }
+    std::shared_lock<std::shared_mutex> lock(embedding_mutex);
+    if (!embedding_model || count == 0) return;
+
+    // Faces are written straight into the bound [N,3,S,S] input of a pooled IoBinding
+    ModelSession::Lease run = embedding_model->acquire();
+    const size_t image_size = 3 * static_cast<size_t>(embedding_input_size) * embedding_input_size;
+    thread_local std::vector<uint8_t> valid;
+
+    // One Run for all faces when the model allows it, otherwise one Run per face
+    const size_t run_size = embedding_model->dynamic_batch() ? count : 1;
+    valid.resize(run_size);
+    run->bind(static_cast<int64_t>(run_size));
+    for (size_t first = 0; first < count; first += run_size) {
+        for (size_t k = 0; k < run_size; ++k) {
+            valid[k] = fill(first + k, run->input(0) + k * image_size);
+        }
+        run->run(run_options);
+
+        const float* output_data = run->output(0);
+        const size_t dim = run->output_row_size(0);
+
+        for (size_t k = 0; k < run_size; ++k) {
+            if (!valid[k]) continue;
+
+            // Copied into the caller's vector, which keeps its capacity from earlier requests
+            std::vector<float>& embedding = embeddings[first + k];
+            embedding.assign(output_data + k * dim, output_data + (k + 1) * dim);
+
+            // L2 normalize
+            float norm = std::sqrt(std::inner_product(embedding.begin(), embedding.end(), embedding.begin(), 0.0f));
+            for (auto& val : embedding) val /= norm;
+        }
+    }
+}
 
-    return embedding;
+void EmbeddingExtractor::release() {
+    std::lock_guard<std::shared_mutex> lock(embedding_mutex);
+    embedding_model.reset();
 }
@@ -1,12 +1,16 @@
 #include "face_alignment.h"
+#include "tensor_kernels.h"
 
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core.hpp>
+#include <cmath>
+#include <iterator>
 
-cv::Mat similarity_transform(const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst) {
-    CV_Assert(src.size() == dst.size() && src.size() >= 2);
-
-    int num_points = static_cast<int>(src.size());
+// Least-squares similarity (rotation, uniform scale, translation) mapping src onto dst, the
+// rotation and scale the SVD of the cross-covariance gives (reflections excluded). In 2D they have
+// a closed form, so nothing is allocated.
+cv::Matx33f similarity_transform(const cv::Point2f* src, const cv::Point2f* dst, int num_points) {
+    CV_Assert(num_points >= 2);
 
     // centroid calculation
     cv::Point2f src_center(0.f, 0.f), dst_center(0.f, 0.f);
@@ -17,54 +21,40 @@ cv::Mat similarity_transform(const std::vector<cv::Point2f>& src, const std::vec
     src_center *= (1.0f / num_points);
     dst_center *= (1.0f / num_points);
 
-    // Centerize
-    std::vector<cv::Point2f> src_demean(num_points), dst_demean(num_points);
-    for (int i = 0; i < num_points; ++i) {
-        src_demean[i] = src[i] - src_center;
-        dst_demean[i] = dst[i] - dst_center;
-    }
-
-    // build Matrix H
-    cv::Mat H = cv::Mat::zeros(2, 2, CV_32F);
+    // Cross-covariance H of the centered points and the variance of src
+    cv::Matx22f H = cv::Matx22f::zeros();
+    float src_var = 0.0f;
     for (int i = 0; i < num_points; ++i) {
-        H += (cv::Mat_<float>(2, 1) << src_demean[i].x, src_demean[i].y) *
-             (cv::Mat_<float>(1, 2) << dst_demean[i].x, dst_demean[i].y);
-    }
-    H /= num_points;
-
-    cv::Mat w, u, vt;
-    cv::SVD::compute(H, w, u, vt);
-    cv::Mat R = vt.t() * u.t();
-
-    float scale = 1.0f;
-    if (cv::determinant(R) < 0) {
-        vt.row(1) *= -1;
-        R = vt.t() * u.t();
+        cv::Point2f s = src[i] - src_center;
+        cv::Point2f d = dst[i] - dst_center;
+        H(0, 0) += s.x * d.x;
+        H(0, 1) += s.x * d.y;
+        H(1, 0) += s.y * d.x;
+        H(1, 1) += s.y * d.y;
+        src_var += s.dot(s);
     }
 
-    float src_var = 0;
-    for (const auto& pt : src_demean)
-        src_var += pt.dot(pt);
-    src_var /= num_points;
-
-    scale = static_cast<float>(cv::sum(w)[0]) / src_var;
-
-    cv::Mat T = cv::Mat::eye(3, 3, CV_32F);
-    cv::Mat M = scale * R;
-    M.copyTo(T(cv::Rect(0, 0, 2, 2)));
-
-    cv::Mat src_center_mat = (cv::Mat_<float>(2, 1) << src_center.x, src_center.y);
-    cv::Mat dst_center_mat = (cv::Mat_<float>(2, 1) << dst_center.x, dst_center.y);
-    cv::Mat trans = dst_center_mat - M * src_center_mat;
-    T.at<float>(0, 2) = trans.at<float>(0);
-    T.at<float>(1, 2) = trans.at<float>(1);
-
-    return T;
+    // Best rotation: angle of (trace, antisymmetric part). Scale: sum of the singular values over the
+    // variance, with sigma1 + sigma2 = sqrt(|H|^2 + 2 |det H|).
+    float c = H(0, 0) + H(1, 1);
+    float s = H(0, 1) - H(1, 0);
+    float norm = std::sqrt(c * c + s * s);
+    float frobenius = H(0, 0) * H(0, 0) + H(0, 1) * H(0, 1) + H(1, 0) * H(1, 0) + H(1, 1) * H(1, 1);
+    float scale = std::sqrt(frobenius + 2.0f * std::abs(cv::determinant(H))) / src_var;
+    float m00 = scale * c / norm;
+    float m10 = scale * s / norm;
+
+    cv::Point2f trans(dst_center.x - (m00 * src_center.x - m10 * src_center.y),
+                      dst_center.y - (m10 * src_center.x + m00 * src_center.y));
+    return cv::Matx33f(m00, -m10, trans.x,
+                       m10, m00, trans.y,
+                       0.0f, 0.0f, 1.0f);
 }
 
-cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceBox) {
-    if (faceBox.landmarks.size() < 4) return image;
+namespace {
 
+// Similarity transform mapping the face landmarks onto the aligned out_size x out_size crop
+cv::Matx33f alignment_transform(const FaceDetectionResult& faceBox, int out_size) {
     // Source points: eye_right, eye_left, nose, mouth
 //    std::vector<cv::Point2f> src_pts = {
 //        faceBox.landmarks[0],
@@ -72,13 +62,13 @@ cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceBox) {
 //        faceBox.landmarks[2],
 //        faceBox.landmarks[3]
 //    };
-    std::vector<cv::Point2f> src_pts = {
-        faceBox.landmarks[0],
-        faceBox.landmarks[1],
-        faceBox.landmarks[2],
-        faceBox.landmarks[3],
-        faceBox.landmarks[4],
-        faceBox.landmarks[5]
+    const cv::Point2f src_pts[] = {
+        faceBox.right_eye(),
+        faceBox.left_eye(),
+        faceBox.nose_tip(),
+        faceBox.mouth(),
+        faceBox.right_ear(),
+        faceBox.left_ear()
     };
 
     // Target points in normalized [0,1] space
@@ -89,7 +79,7 @@ cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceBox) {
 //        {0.50f, 0.75f}
 //    };
     
-    std::vector<cv::Point2f> dst_pts = {
+    cv::Point2f dst_pts[] = {
         {0.3410f, 0.4600f},  // left eye
         {0.6550f, 0.4600f},  // right eye
         {0.4980f, 0.6100f},  // nose
@@ -99,13 +89,21 @@ cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceBox) {
     };
     
 
-    int out_size = 112; // Auraface expects a 112 px image
     for (auto& pt : dst_pts) {
         pt.x *= out_size;
         pt.y *= out_size;
     }
 
-    cv::Mat transform = similarity_transform(src_pts, dst_pts);
+    return similarity_transform(src_pts, dst_pts, static_cast<int>(std::size(dst_pts)));
+}
+
+} // namespace
+
+cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceBox) {
+    if (faceBox.landmark_count < FaceDetectionResult::MAX_LANDMARKS) return image;
+
+    int out_size = 112; // Auraface expects a 112 px image
+    cv::Mat transform(alignment_transform(faceBox, out_size));
     cv::Mat aligned;
     cv::warpPerspective(image, aligned, transform, cv::Size(out_size, out_size), cv::INTER_LINEAR, cv::BORDER_REPLICATE);
     
@@ -116,3 +114,19 @@ cv::Mat align_face(const cv::Mat& image, const FaceDetectionResult& faceBox) {
 //    return normalized;
     return aligned;
 }
+
+bool align_face_to_tensor(const Frame& frame, const FaceDetectionResult& faceBox, int out_size,
+                          const TensorNorm& norm, float* dst) {
+    // Without the full landmark set the whole frame is used, like the resize in the Mat path
+    if (faceBox.landmark_count < FaceDetectionResult::MAX_LANDMARKS) {
+        return resize_to_tensor(frame, cv::Rect(0, 0, frame.width, frame.height),
+                                cv::Size(out_size, out_size), cv::Size(out_size, out_size), norm, dst);
+    }
+
+    // The transform is a similarity, so its inverse is affine: sample the frame directly
+    cv::Matx33f transform = alignment_transform(faceBox, out_size);
+    cv::Matx33f inverse = transform.inv();
+    cv::Matx23f dst_to_src(inverse(0, 0), inverse(0, 1), inverse(0, 2),
+                           inverse(1, 0), inverse(1, 1), inverse(1, 2));
+    return warp_to_tensor(frame, dst_to_src, cv::Size(out_size, out_size), norm, dst);
+}
@@ -1,69 +1,16 @@
 #include "face_detection.h"
+#include "frame.h"
+#include "ort_session.h"
+#include "tensor_kernels.h"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include <cstdint>
 #include <iostream>
-#include <mutex>
-#include <numeric>
+#include <shared_mutex>
+#include <algorithm>
 
 namespace {
 
-Ort::Env& getOrtEnv() {
-    static Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "FaceDetection");
-    return env;
-}
-
-std::unique_ptr<Ort::Session> face_session;
-std::mutex session_mutex;
-
-int input_width = 128;
-int input_height = 128;
-float threshold = 0.6f;
-float iou_threshold = 0.3f;
-
-cv::Mat preprocess_image(const cv::Mat& image, float& scale_out) {
-    cv::Mat rgb;
-    cv::cvtColor(image, rgb, cv::COLOR_BGR2RGB);
-
-    int target_width = input_width;
-    int target_height = input_height;
-
-    // Calculate scale keeping aspect ratio
-    float scale = std::min(
-        static_cast<float>(target_width) / rgb.cols,
-        static_cast<float>(target_height) / rgb.rows
-    );
-    scale_out = scale;
-
-    int new_w = static_cast<int>(rgb.cols * scale);
-    int new_h = static_cast<int>(rgb.rows * scale);
-
-    cv::Mat resized;
-    cv::resize(rgb, resized, cv::Size(new_w, new_h), 0, 0, cv::INTER_CUBIC);
-
-    // Place resized image on black background
-    cv::Mat padded = cv::Mat::zeros(target_height, target_width, CV_8UC3);
-    resized.copyTo(padded(cv::Rect(0, 0, resized.cols, resized.rows)));
-
-    // Convert to float32
-    cv::Mat chw;
-    padded.convertTo(padded, CV_32F); // Keep values in [0,255]
-
-    std::vector<cv::Mat> channels(3);
-    cv::split(padded, channels);
-
-    std::vector<float> data(3 * target_width * target_height);
-    for (int i = 0; i < 3; ++i) {
-        std::memcpy(
-            &data[i * target_width * target_height],
-            channels[i].data,
-            target_width * target_height * sizeof(float)
-        );
-    }
-
-    return cv::Mat(1, 3 * target_width * target_height, CV_32F, data.data()).clone();
-}
-
-
 float IoU(const cv::Rect& a, const cv::Rect& b) {
     int x1 = std::max(a.x, b.x);
     int y1 = std::max(a.y, b.y);
@@ -74,149 +21,120 @@ float IoU(const cv::Rect& a, const cv::Rect& b) {
     return unionArea > 0 ? static_cast<float>(interArea) / unionArea : 0.0f;
 }
 
-std::vector<int> non_max_suppression(const std::vector<cv::Rect>& boxes, const std::vector<float>& scores, float threshold_iou) {
-    std::vector<int> indices(boxes.size());
-    std::iota(indices.begin(), indices.end(), 0);
-    std::sort(indices.begin(), indices.end(), [&](int i, int j) {
-        return scores[i] > scores[j];
-    });
-
-    std::vector<int> keep;
-    std::vector<bool> suppressed(boxes.size(), false);
-
-    for (size_t _i = 0; _i < indices.size(); ++_i) {
-        int i = indices[_i];
-        if (suppressed[i]) continue;
-        keep.push_back(i);
-        for (size_t _j = _i + 1; _j < indices.size(); ++_j) {
-            int j = indices[_j];
-            if (IoU(boxes[i], boxes[j]) > threshold_iou) {
-                suppressed[j] = true;
-            }
-        }
-    }
-    return keep;
-}
-
 } // namespace
 
-bool init_face_detector(Ort::SessionOptions& options, const std::string& model_path, bool short_range) {
-    try {
-        std::lock_guard<std::mutex> lock(session_mutex);
-        input_width = short_range ? 128 : 256;
-        input_height = short_range ? 128 : 256;
-
-        face_session = std::make_unique<Ort::Session>(getOrtEnv(), model_path.c_str(), options);
-        std::cout << "[FaceDetector] Loaded model: " << model_path << std::endl;
-
-//        Ort::AllocatorWithDefaultOptions allocator;
-//        size_t count = face_session->GetOutputCount();
-//        for (size_t i = 0; i < count; ++i) {
-//            auto name = face_session->GetOutputNameAllocated(i, allocator);
-//            std::cout << "[FaceDetector] Output[" << i << "] name: " << name.get() << std::endl;
-//        }
-        return true;
-    } catch (const Ort::Exception& e) {
-        std::cerr << "[FaceDetector] Failed to load model: " << e.what() << std::endl;
-        return false;
-    }
-}
-
-std::vector<FaceDetectionResult> detect_faces(const cv::Mat& image) {
-    std::lock_guard<std::mutex> lock(session_mutex);
-    if (!face_session) return {};
-
-    float scale = 1.0f;
-    cv::Mat input = preprocess_image(image, scale);
+bool FaceDetector::preprocess_image(const Frame& frame, float& scale_out, float* dst) const {
+    int target_width = input_width;
+    int target_height = input_height;
 
-    std::vector<int64_t> input_dims = {1, 3, input_height, input_width};
-    Ort::MemoryInfo mem_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
-        mem_info, input.ptr<float>(), input.total(), input_dims.data(), input_dims.size()
+    // Calculate scale keeping aspect ratio
+    float scale = std::min(
+        static_cast<float>(target_width) / frame.width,
+        static_cast<float>(target_height) / frame.height
     );
+    scale_out = scale;
 
-    // Hold AllocatedStringPtrs so their memory stays valid
-    Ort::AllocatorWithDefaultOptions allocator;
-
-    std::vector<Ort::AllocatedStringPtr> input_name_holders;
-    std::vector<const char*> input_names;
-    input_name_holders.emplace_back(face_session->GetInputNameAllocated(0, allocator));
-    input_names.push_back(input_name_holders[0].get());
-
-    std::vector<Ort::AllocatedStringPtr> output_name_holders;
-    std::vector<const char*> output_names;
-    for (int i = 0; i < 3; ++i) {
-        output_name_holders.emplace_back(face_session->GetOutputNameAllocated(i, allocator));
-        output_names.push_back(output_name_holders[i].get());
-    }
+    int new_w = static_cast<int>(frame.width * scale);
+    int new_h = static_cast<int>(frame.height * scale);
 
-    // Run the model
-    auto outputs = face_session->Run(
-        Ort::RunOptions{nullptr},
-        input_names.data(), &input_tensor, 1,
-        output_names.data(), 3
-    );
+    // Resize, RGB conversion, black letterbox and CHW float layout in one pass, values stay in [0,255]
+    return resize_to_tensor(frame, cv::Rect(0, 0, frame.width, frame.height), cv::Size(new_w, new_h),
+                            cv::Size(target_width, target_height), input_norm, dst);
+}
 
-    
-    auto shape_scores = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
-    auto shape_boxes = outputs[1].GetTensorTypeAndShapeInfo().GetShape();
-    auto shape_landmarks = outputs[2].GetTensorTypeAndShapeInfo().GetShape();
-
-//    std::cout << "[ONNX] scores shape: ";
-//    for (auto d : shape_scores) std::cout << d << " ";
-//    std::cout << "\n[ONNX] boxes shape: ";
-//    for (auto d : shape_boxes) std::cout << d << " ";
-//    std::cout << "\n[ONNX] landmarks shape: ";
-//    for (auto d : shape_landmarks) std::cout << d << " ";
-//    std::cout << std::endl;
-
-    // 🔧 Extract output tensors
-    float* scores    = outputs[0].GetTensorMutableData<float>();
-    float* boxes     = outputs[1].GetTensorMutableData<float>();
-    float* landmarks = outputs[2].GetTensorMutableData<float>();
-    
-//    std::cout << "[ONNX] First 10 scores: ";
-//    for (int i = 0; i < 10; ++i) std::cout << scores[i] << " ";
-//    std::cout << std::endl;
-
-    std::vector<cv::Rect> raw_boxes;
-    std::vector<std::vector<cv::Point2f>> raw_landmarks;
-    std::vector<float> raw_scores;
-
-    for (int i = 0; i < 896; ++i) {
-        float score = scores[i];
-        if (score < threshold) continue;
-        
+// Candidates above threshold are found with a vector scan, only their boxes are decoded and only
+// the faces that survive NMS get landmarks. Greedy NMS against the kept faces gives the same faces
+// as full pairwise suppression.
+void FaceDetector::decode_detections(const float* scores, const float* boxes, const float* landmarks, int anchors,
+                                     int landmark_count, float scale, std::vector<FaceDetectionResult>& results) const {
+    results.clear();
+    thread_local std::vector<int> candidates;
+    // Face each candidate belongs to, -1 when it is skipped
+    thread_local std::vector<int> owners;
+    thread_local std::vector<cv::Rect> kept_boxes;
+    candidates.resize(anchors);
+    const int count = select_scores(scores, anchors, threshold, candidates.data());
+    if (count == 0) return;
+
+    auto by_score = [scores](int a, int b) { return scores[a] > scores[b]; };
+    auto decode_box = [&](int i) {
         float x1 = boxes[i * 4 + 0] / scale;
         float y1 = boxes[i * 4 + 1] / scale;
-        float x2  = boxes[i * 4 + 2] / scale;
-        float y2  = boxes[i * 4 + 3] / scale;
+        float x2 = boxes[i * 4 + 2] / scale;
+        float y2 = boxes[i * 4 + 3] / scale;
+        return cv::Rect(cv::Point(x1, y1), cv::Point(x2, y2));
+    };
+    // Models with more points than a FaceDetectionResult holds keep the first MAX_LANDMARKS
+    const int kept_landmarks = std::min(landmark_count, FaceDetectionResult::MAX_LANDMARKS);
+    auto decode_face = [&](int i) {
+        FaceDetectionResult face;
+        face.box = decode_box(i);
+        face.score = scores[i];
+        face.landmark_count = kept_landmarks;
+        for (int j = 0; j < kept_landmarks; ++j) {
+            float lx = landmarks[(i * landmark_count + j) * 2 + 0] / scale;
+            float ly = landmarks[(i * landmark_count + j) * 2 + 1] / scale;
+            face.landmarks[j] = cv::Point2f(lx, ly);
+        }
+        return face;
+    };
 
-        
-        raw_boxes.emplace_back(cv::Rect(cv::Point(x1, y1), cv::Point(x2, y2)));
+    // Without blending the best face is simply the top score
+    if (best_face_only && !blend_boxes) {
+        results.push_back(decode_face(*std::min_element(candidates.begin(), candidates.begin() + count, by_score)));
+        return;
+    }
 
-        std::vector<cv::Point2f> lm;
-        for (int j = 0; j < 6; ++j) {
-            float lx = landmarks[i * 12 + j * 2 + 0] / scale;
-            float ly = landmarks[i * 12 + j * 2 + 1] / scale;
-            lm.emplace_back(cv::Point2f(lx, ly));
+    std::sort(candidates.begin(), candidates.begin() + count, by_score);
+    owners.assign(count, -1);
+    kept_boxes.clear();
+    for (int c = 0; c < count; ++c) {
+        const cv::Rect box = decode_box(candidates[c]);
+        int owner = -1;
+        for (size_t k = 0; k < kept_boxes.size() && owner < 0; ++k) {
+            if (IoU(kept_boxes[k], box) > iou_threshold) owner = static_cast<int>(k);
         }
-        raw_landmarks.push_back(lm);
-        raw_scores.push_back(score);
+        if (owner < 0) {
+            if (best_face_only && !kept_boxes.empty()) continue;
+            owner = static_cast<int>(kept_boxes.size());
+            kept_boxes.push_back(box);
+        }
+        owners[c] = owner;
     }
 
-    std::vector<int> keep = non_max_suppression(raw_boxes, raw_scores, iou_threshold);
-
-    std::vector<FaceDetectionResult> results;
-    for (int idx : keep) {
-        results.push_back({raw_boxes[idx], raw_landmarks[idx], raw_scores[idx]});
+    // Kept faces come out in descending score order
+    for (size_t k = 0; k < kept_boxes.size(); ++k) {
+        int top = -1;
+        float weight_sum = 0.0f;
+        float corners[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        FaceDetectionResult face;
+        for (int c = 0; c < count; ++c) {
+            if (owners[c] != static_cast<int>(k)) continue;
+            const int i = candidates[c];
+            if (top < 0) {
+                top = i;
+                face = decode_face(i);
+                if (!blend_boxes) break;
+                face.landmarks.fill(cv::Point2f(0.0f, 0.0f));
+            }
+            // The face keeps the top score, its geometry is averaged with the candidates' scores as weights
+            const float w = scores[i];
+            weight_sum += w;
+            for (int v = 0; v < 4; ++v) corners[v] += w * boxes[i * 4 + v];
+            for (int j = 0; j < kept_landmarks; ++j) {
+                face.landmarks[j].x += w * landmarks[(i * landmark_count + j) * 2 + 0];
+                face.landmarks[j].y += w * landmarks[(i * landmark_count + j) * 2 + 1];
+            }
+        }
+        if (blend_boxes) {
+            const float norm = 1.0f / (weight_sum * scale);
+            face.box = cv::Rect(cv::Point(corners[0] * norm, corners[1] * norm),
+                                cv::Point(corners[2] * norm, corners[3] * norm));
+            for (int j = 0; j < kept_landmarks; ++j) face.landmarks[j] *= norm;
+        }
+        results.push_back(face);
     }
 
-    // sort by score descending
-    std::sort(results.begin(), results.end(), [](const FaceDetectionResult& a, const FaceDetectionResult& b) {
-        return a.score > b.score;
-    });
-    
 //    if (!results.empty()) {
 //        const auto& top = results.front();
 //        std::cout << "[DEBUG] Top score: " << top.score << "\n";
@@ -227,6 +145,112 @@ std::vector<FaceDetectionResult> detect_faces(const cv::Mat& image) {
 //            std::cout << "  (" << pt.x << ", " << pt.y << ")\n";
 //        }
 //    }
+}
+
+bool FaceDetector::init(const OrtSettings& settings, const ModelFile& model, const FaceDetectorOptions& options) {
+    try {
+        std::lock_guard<std::shared_mutex> lock(session_mutex);
+        face_model = std::make_unique<ModelSession>(create_session(model, settings));
+        const SessionIO& io = face_model->io();
+        if (io.input_names.size() != 1 || io.output_names.size() < 3 ||
+            !face_model->resolve_image_input(0, options.input_size, input_height, input_width)) {
+            std::cerr << "[FaceDetector] Unexpected model inputs/outputs: " << model.name() << std::endl;
+            face_model.reset();
+            return false;
+        }
+        input_norm = options.norm;
+        best_face_only = options.best_face_only;
+        blend_boxes = options.blend_boxes;
+
+        // Outputs are told apart by their last dimension when the model declares it, otherwise
+        // they are taken in order
+        size_t found[3] = {SIZE_MAX, SIZE_MAX, SIZE_MAX};
+        for (size_t i = 0; i < io.output_shapes.size(); ++i) {
+            const auto& shape = io.output_shapes[i];
+            if (shape.size() != 3) continue;
+            if (shape[2] == 1) found[0] = i;
+            else if (shape[2] == 4) found[1] = i;
+            else if (shape[2] > 4 && shape[2] % 2 == 0) found[2] = i;
+        }
+        const bool by_shape = found[0] != SIZE_MAX && found[1] != SIZE_MAX && found[2] != SIZE_MAX;
+        score_output = by_shape ? found[0] : 0;
+        box_output = by_shape ? found[1] : 1;
+        landmark_output = by_shape ? found[2] : 2;
+
+        std::cout << "[FaceDetector] Loaded model: " << model.name() << " (" << input_width << "x" << input_height
+                  << (face_model->dynamic_batch() ? ", batched" : "") << ")" << std::endl;
+        std::cout << "[FaceDetector] Outputs: scores " << io.output_names[score_output]
+                  << ", boxes " << io.output_names[box_output]
+                  << ", landmarks " << io.output_names[landmark_output] << std::endl;
+        return true;
+    } catch (const Ort::Exception& e) {
+        std::cerr << "[FaceDetector] Failed to load model: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+std::vector<FaceDetectionResult> FaceDetector::detect_faces(const cv::Mat& image) {
+    return detect_faces(frame_from_mat(image));
+}
+
+std::vector<FaceDetectionResult> FaceDetector::detect_faces(const Frame& frame) {
+    std::vector<FaceDetectionResult> faces;
+    detect_faces(&frame, 1, &faces);
+    return faces;
+}
 
+std::vector<std::vector<FaceDetectionResult>> FaceDetector::detect_faces(const std::vector<Frame>& frames) {
+    std::vector<std::vector<FaceDetectionResult>> results(frames.size());
+    detect_faces(frames.data(), frames.size(), results.data());
     return results;
 }
+
+void FaceDetector::detect_faces(const Frame* frames, size_t count, std::vector<FaceDetectionResult>* results) {
+    for (size_t i = 0; i < count; ++i) results[i].clear();
+    std::shared_lock<std::shared_mutex> lock(session_mutex);
+    if (!face_model || count == 0) return;
+
+    // Images are letterboxed straight into the bound input of a pooled IoBinding, the scores,
+    // boxes and landmarks land in its preallocated outputs
+    ModelSession::Lease run = face_model->acquire();
+    const size_t image_size = 3 * static_cast<size_t>(input_width) * input_height;
+    thread_local std::vector<float> scales;
+    thread_local std::vector<uint8_t> valid;
+
+    // One Run for the whole batch when the model allows it, otherwise one Run per image
+    const size_t run_size = face_model->dynamic_batch() ? count : 1;
+    scales.resize(run_size);
+    valid.resize(run_size);
+    run->bind(static_cast<int64_t>(run_size));
+    for (size_t first = 0; first < count; first += run_size) {
+        for (size_t k = 0; k < run_size; ++k) {
+            valid[k] = preprocess_image(frames[first + k], scales[k], run->input(0) + k * image_size);
+        }
+        run->run(Ort::RunOptions{nullptr});
+
+//        std::cout << "[ONNX] scores per image: " << run->output_row_size(0) << std::endl;
+
+        // Each image owns an equal slice of every output
+        const float* scores    = run->output(score_output);
+        const float* boxes     = run->output(box_output);
+        const float* landmarks = run->output(landmark_output);
+        const int anchors = static_cast<int>(run->output_row_size(score_output));
+        if (anchors == 0 || run->output_row_size(box_output) != static_cast<size_t>(anchors) * 4) {
+            std::cerr << "[FaceDetector] Outputs don't match: " << anchors << " scores for "
+                      << run->output_row_size(box_output) / 4 << " boxes" << std::endl;
+            break;
+        }
+        const int landmark_count = static_cast<int>(run->output_row_size(landmark_output) / anchors / 2);
+
+        for (size_t k = 0; k < run_size; ++k) {
+            if (!valid[k]) continue;
+            decode_detections(scores + k * anchors, boxes + k * anchors * 4, landmarks + k * anchors * landmark_count * 2,
+                              anchors, landmark_count, scales[k], results[first + k]);
+        }
+    }
+}
+
+void FaceDetector::release() {
+    std::lock_guard<std::shared_mutex> lock(session_mutex);
+    face_model.reset();
+}
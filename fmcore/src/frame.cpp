@@ -0,0 +1,217 @@
+#include "frame.h"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <iostream>
+
+const YuvCoeffs kVideoRange = {16.0f, 1.164f, 1.596f, 0.391f, 0.813f, 2.018f};
+const YuvCoeffs kFullRange = {0.0f, 1.0f, 1.402f, 0.344f, 0.714f, 1.772f};
+
+int packed_channels(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::BGR:
+        case PixelFormat::RGB:
+            return 3;
+        case PixelFormat::RGBA:
+        case PixelFormat::BGRA:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+const YuvCoeffs& yuv_coeffs(const Frame& frame) {
+    return frame.fullRange ? kFullRange : kVideoRange;
+}
+
+namespace {
+
+cv::Mat wrap_plane(const FramePlane& plane, int rows, int cols, int type) {
+    return cv::Mat(rows, cols, type, const_cast<uint8_t*>(plane.data), static_cast<size_t>(plane.rowStride));
+}
+
+cv::Mat packed_to_mat(const Frame& frame, bool toRgb) {
+    cv::Mat src = wrap_plane(frame.planes[0], frame.height, frame.width,
+                             packed_channels(frame.format) == 4 ? CV_8UC4 : CV_8UC3);
+    cv::Mat dst;
+    switch (frame.format) {
+        case PixelFormat::BGR:
+            if (!toRgb) return src;
+            cv::cvtColor(src, dst, cv::COLOR_BGR2RGB);
+            break;
+        case PixelFormat::RGB:
+            if (toRgb) return src;
+            cv::cvtColor(src, dst, cv::COLOR_RGB2BGR);
+            break;
+        case PixelFormat::RGBA:
+            cv::cvtColor(src, dst, toRgb ? cv::COLOR_RGBA2RGB : cv::COLOR_RGBA2BGR);
+            break;
+        case PixelFormat::BGRA:
+            cv::cvtColor(src, dst, toRgb ? cv::COLOR_BGRA2RGB : cv::COLOR_BGRA2BGR);
+            break;
+        default:
+            break;
+    }
+    return dst;
+}
+
+inline uint8_t clamp_u8(float v) {
+    return static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, v + 0.5f)));
+}
+
+inline void yuv_to_pixel(float luma, float u, float v, const YuvCoeffs& c, bool toRgb, uint8_t* out) {
+    float l = c.yScale * (luma - c.yOffset);
+    u -= 128.0f;
+    v -= 128.0f;
+    uint8_t r = clamp_u8(l + c.rv * v);
+    uint8_t g = clamp_u8(l - c.gv * v - c.gu * u);
+    uint8_t b = clamp_u8(l + c.bu * u);
+    out[0] = toRgb ? r : b;
+    out[1] = g;
+    out[2] = toRgb ? b : r;
+}
+
+// Per pixel conversion, used for full range frames that OpenCV's YUV conversions don't cover
+cv::Mat yuv_to_mat_exact(const Frame& frame, bool toRgb, const YuvCoeffs& coeffs) {
+    const FramePlane& yp = frame.planes[0];
+    const FramePlane& up = frame.planes[1];
+    const FramePlane& vp = frame.planes[2];
+    cv::Mat dst(frame.height, frame.width, CV_8UC3);
+    for (int row = 0; row < frame.height; ++row) {
+        const uint8_t* yRow = yp.data + static_cast<size_t>(row) * yp.rowStride;
+        const uint8_t* uRow = up.data + static_cast<size_t>(row / 2) * up.rowStride;
+        const uint8_t* vRow = vp.data + static_cast<size_t>(row / 2) * vp.rowStride;
+        uint8_t* out = dst.ptr<uint8_t>(row);
+        for (int col = 0; col < frame.width; ++col) {
+            int c = col / 2;
+            yuv_to_pixel(yRow[col], uRow[c * up.pixelStride], vRow[c * vp.pixelStride], coeffs, toRgb, out + 3 * col);
+        }
+    }
+    return dst;
+}
+
+cv::Mat yuv_to_mat(const Frame& frame, bool toRgb) {
+    const FramePlane& y = frame.planes[0];
+    const FramePlane& u = frame.planes[1];
+    const FramePlane& v = frame.planes[2];
+    const int w = frame.width;
+    const int h = frame.height;
+    cv::Mat dst;
+
+    if (frame.fullRange) {
+        return yuv_to_mat_exact(frame, toRgb, kFullRange);
+    }
+
+    // Semi-planar chroma (NV12/NV21 or YUV_420_888 with pixelStride 2)
+    if (u.pixelStride == 2 && v.pixelStride == 2 && u.rowStride == v.rowStride && std::abs(u.data - v.data) == 1) {
+        bool uFirst = u.data < v.data;
+        cv::Mat yMat = wrap_plane(y, h, w, CV_8UC1);
+        cv::Mat uvMat = wrap_plane(uFirst ? u : v, h / 2, w / 2, CV_8UC2);
+        int code = uFirst ? (toRgb ? cv::COLOR_YUV2RGB_NV12 : cv::COLOR_YUV2BGR_NV12)
+                          : (toRgb ? cv::COLOR_YUV2RGB_NV21 : cv::COLOR_YUV2BGR_NV21);
+        cv::cvtColorTwoPlane(yMat, uvMat, dst, code);
+        return dst;
+    }
+
+    const int code = toRgb ? cv::COLOR_YUV2RGB_I420 : cv::COLOR_YUV2BGR_I420;
+
+    // Fully planar chroma: OpenCV expects the three planes packed one after the other
+    const uint8_t* contiguousEnd = y.data + static_cast<size_t>(w) * h;
+    if (u.pixelStride == 1 && v.pixelStride == 1 && y.rowStride == w && u.rowStride == w / 2 && v.rowStride == w / 2 &&
+        u.data == contiguousEnd && v.data == contiguousEnd + static_cast<size_t>(w / 2) * (h / 2)) {
+        cv::Mat i420(h * 3 / 2, w, CV_8UC1, const_cast<uint8_t*>(y.data));
+        cv::cvtColor(i420, dst, code);
+        return dst;
+    }
+
+    // Arbitrary strides: gather the planes into an I420 buffer first
+    cv::Mat i420(h * 3 / 2, w, CV_8UC1);
+    wrap_plane(y, h, w, CV_8UC1).copyTo(i420(cv::Rect(0, 0, w, h)));
+    uint8_t* dstU = i420.ptr<uint8_t>(h);
+    uint8_t* dstV = dstU + (w / 2) * (h / 2);
+    for (int row = 0; row < h / 2; ++row) {
+        const uint8_t* srcU = u.data + static_cast<size_t>(row) * u.rowStride;
+        const uint8_t* srcV = v.data + static_cast<size_t>(row) * v.rowStride;
+        for (int col = 0; col < w / 2; ++col) {
+            *dstU++ = srcU[col * u.pixelStride];
+            *dstV++ = srcV[col * v.pixelStride];
+        }
+    }
+    cv::cvtColor(i420, dst, code);
+    return dst;
+}
+
+cv::Mat frame_to_mat(const Frame& frame, bool toRgb) {
+    if (!validate_frame(frame)) return {};
+    return is_yuv_format(frame.format) ? yuv_to_mat(frame, toRgb) : packed_to_mat(frame, toRgb);
+}
+
+} // namespace
+
+Frame makeFrame(const uint8_t* data, int width, int height, int stride, PixelFormat format) {
+    Frame frame;
+    frame.format = format;
+    frame.width = width;
+    frame.height = height;
+    frame.planes[0] = {data, stride, 1};
+
+    const uint8_t* chroma = data + static_cast<size_t>(stride) * height;
+    switch (format) {
+        case PixelFormat::NV12:
+            frame.planes[1] = {chroma, stride, 2};
+            frame.planes[2] = {chroma + 1, stride, 2};
+            break;
+        case PixelFormat::NV21:
+            frame.planes[1] = {chroma + 1, stride, 2};
+            frame.planes[2] = {chroma, stride, 2};
+            break;
+        case PixelFormat::I420:
+            frame.planes[1] = {chroma, stride / 2, 1};
+            frame.planes[2] = {chroma + static_cast<size_t>(stride / 2) * (height / 2), stride / 2, 1};
+            break;
+        default:
+            break;
+    }
+    return frame;
+}
+
+bool is_yuv_format(PixelFormat format) {
+    return format == PixelFormat::NV21 || format == PixelFormat::NV12 || format == PixelFormat::I420;
+}
+
+bool validate_frame(const Frame& frame) {
+    if (frame.width <= 0 || frame.height <= 0 || frame.planes[0].data == nullptr) {
+        std::cerr << "[Frame] Empty frame." << std::endl;
+        return false;
+    }
+    if (!is_yuv_format(frame.format)) {
+        if (frame.planes[0].rowStride < frame.width * packed_channels(frame.format)) {
+            std::cerr << "[Frame] Row stride smaller than the image width." << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if (frame.width % 2 != 0 || frame.height % 2 != 0) {
+        std::cerr << "[Frame] YUV 4:2:0 frames need even width and height." << std::endl;
+        return false;
+    }
+    if (frame.planes[1].data == nullptr || frame.planes[2].data == nullptr ||
+        frame.planes[0].rowStride < frame.width) {
+        std::cerr << "[Frame] Invalid YUV planes." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Frame frame_from_mat(const cv::Mat& bgr) {
+    CV_Assert(bgr.type() == CV_8UC3);
+    Frame frame;
+    frame.format = PixelFormat::BGR;
+    frame.width = bgr.cols;
+    frame.height = bgr.rows;
+    frame.planes[0] = {bgr.data, static_cast<int>(bgr.step), 1};
+    return frame;
+}
+
+cv::Mat frame_to_bgr(const Frame& frame) {
+    return frame_to_mat(frame, false);
+}
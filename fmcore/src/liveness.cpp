@@ -1,50 +1,84 @@
 // liveness.cpp
 #include "liveness.h"
+#include "frame.h"
+#include "ort_session.h"
+#include "tensor_kernels.h"
+#include <algorithm>
 #include <iostream>
+#include <shared_mutex>
 #include <opencv2/imgproc.hpp>
 
-static std::vector<std::unique_ptr<Ort::Session>> liveness_sessions;
-std::mutex liveness_mutex;
-static std::vector<std::string> liveness_input_names;
-static float liveness_thresh;
-static const int MODEL_INPUT_SIZE = 80;
-static float scales[] = {4.0, 2.7};
-
-Ort::Env& getOrtEnv() {
-    static Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "Liveness");
-    return env;
-}
-
-bool init_liveness_detector(Ort::SessionOptions& session_options, const std::vector<std::string>& model_paths, const float liveness_threshold) {
+bool LivenessDetector::init(const OrtSettings& settings, const std::vector<ModelFile>& models,
+                            const float liveness_threshold, const LivenessOptions& options, bool parallel_members) {
+    std::lock_guard<std::shared_mutex> lock(liveness_mutex);
+    // A failed init leaves no members behind, run_liveness_check then reports no valid sessions
+    auto discard_members = [this]() {
+        liveness_models.clear();
+        member_sizes.clear();
+        member_pool.reset();
+        fused_ensemble = false;
+    };
+    discard_members();
     try {
-        std::lock_guard<std::mutex> lock(liveness_mutex);
-        liveness_sessions.clear();
-        for (const auto& model_path : model_paths) {
-            auto session = std::make_unique<Ort::Session>(getOrtEnv(), model_path.c_str(), session_options);
-            liveness_sessions.push_back(std::move(session));
+        const size_t member_count = options.crop_scales.size();
+        if (member_count == 0 || (models.size() != 1 && models.size() != member_count)) {
+            std::cerr << "[Liveness] " << models.size() << " model(s) for " << member_count << " crop scale(s)." << std::endl;
+            return false;
+        }
+        // The members are independent sessions, so they are parsed and optimized side by side
+        ThreadPool loaders(models.size());
+        std::vector<std::future<std::unique_ptr<ModelSession>>> loading;
+        for (const auto& model : models) {
+            loading.push_back(loaders.submit([&settings, model]() {
+                return std::make_unique<ModelSession>(create_session(model, settings));
+            }));
+        }
+        for (auto& model : loading) {
+            liveness_models.push_back(model.get());
         }
 
-        Ort::AllocatorWithDefaultOptions allocator;
-        Ort::AllocatedStringPtr input_name0 = liveness_sessions[0]->GetInputNameAllocated(0, allocator);
-        Ort::AllocatedStringPtr input_name1 = liveness_sessions[1]->GetInputNameAllocated(0, allocator);
-        liveness_input_names.push_back(input_name0.get());
-        liveness_input_names.push_back(input_name1.get());
+        // Member i reads input i and writes output i of a fused graph, or input/output 0 of session i
+        fused_ensemble = liveness_models.size() == 1 && member_count > 1;
+        for (size_t m = 0; m < member_count; ++m) {
+            ModelSession& model = *liveness_models[fused_ensemble ? 0 : m];
+            const size_t slot = fused_ensemble ? m : 0;
+            int height = 0, width = 0;
+            if (slot >= model.io().output_names.size() ||
+                !model.resolve_image_input(slot, options.input_size, height, width)) {
+                std::cerr << "[Liveness] Model has no image input/output for member " << m << "." << std::endl;
+                discard_members();
+                return false;
+            }
+            member_sizes.emplace_back(width, height);
+        }
+        crop_scales = options.crop_scales;
+        input_norm = options.norm;
+        real_class = options.real_class;
         liveness_thresh = liveness_threshold;
 
-        std::cout << "[Liveness] Loaded " << liveness_sessions.size() << " model(s)." << std::endl;
+        // Each member is its own session and Run executes on the calling thread, so they can run side by side
+        if (parallel_members && !fused_ensemble && member_count > 1) {
+            member_pool = std::make_unique<ThreadPool>(member_count - 1);
+        }
+
+        std::cout << "[Liveness] Loaded " << liveness_models.size() << " model(s)"
+                  << (fused_ensemble ? " (fused ensemble)" : "")
+                  << (member_pool ? " (parallel)" : "") << "." << std::endl;
         return true;
-    } catch (const Ort::Exception& e) {
+    } catch (const std::exception& e) {
+        // Ort::Exception from session creation, or whatever a loader thread threw
         std::cerr << "[Liveness] Failed to load ONNX models: " << e.what() << std::endl;
+        discard_members();
         return false;
     }
 }
 
-cv::Mat preprocess_liveness_crop(const cv::Mat& input_image, const FaceDetectionResult& face, int target_size = 80, float scale = 4.0f) {
-    cv::Mat rgb;
-    cv::cvtColor(input_image, rgb, cv::COLOR_BGR2RGB);
+namespace {
 
-    int src_w = rgb.cols;
-    int src_h = rgb.rows;
+// Scaled face box clamped to the frame, the region each liveness model looks at
+bool liveness_crop_rect(const Frame& frame, const FaceDetectionResult& face, float scale, cv::Rect& crop) {
+    int src_w = frame.width;
+    int src_h = frame.height;
 
     int x = face.box.x;
     int y = face.box.y;
@@ -54,7 +88,7 @@ cv::Mat preprocess_liveness_crop(const cv::Mat& input_image, const FaceDetection
     // Ensure valid bbox
     if (box_w <= 0 || box_h <= 0) {
         std::cerr << "[Liveness] Invalid face bounding box." << std::endl;
-        return {};
+        return false;
     }
 
     // Calculate center and scaled box size
@@ -87,7 +121,7 @@ cv::Mat preprocess_liveness_crop(const cv::Mat& input_image, const FaceDetection
         right_bottom_y = src_h - 1;
     }
 
-    // Final crop and resize
+    // Final crop
     int x1 = std::max(0, (int)left_top_x);
     int y1 = std::max(0, (int)left_top_y);
     int x2 = std::min(src_w, (int)right_bottom_x);
@@ -95,89 +129,159 @@ cv::Mat preprocess_liveness_crop(const cv::Mat& input_image, const FaceDetection
 
     if ((x2 - x1) <= 0 || (y2 - y1) <= 0) {
         std::cerr << "[Liveness] Invalid crop region after adjustment." << std::endl;
-        return {};
+        return false;
     }
 
-    cv::Mat cropped = rgb(cv::Rect(x1, y1, x2 - x1, y2 - y1)).clone();
-    cv::Mat resized;
-    cv::resize(cropped, resized, cv::Size(target_size, target_size));
-    
-    return resized;
+    crop = cv::Rect(x1, y1, x2 - x1, y2 - y1);
+    return true;
 }
 
+} // namespace
 
+LivenessResult LivenessDetector::run_liveness_check(const cv::Mat& input_image, const FaceDetectionResult& face) {
+    return run_liveness_check(frame_from_mat(input_image), face);
+}
 
-LivenessResult run_liveness_check(const cv::Mat& input_image, const FaceDetectionResult& face) {
-    LivenessResult lr;
-    
-    if (liveness_sessions.empty()) {
-        std::cerr << "[Liveness] ERROR: no valid sessions" << std::endl;
-        return lr;
+LivenessResult LivenessDetector::run_liveness_check(const Frame& frame, const FaceDetectionResult& face) {
+    LivenessResult result;
+    run_liveness_check(&frame, &face, 1, &result);
+    return result;
+}
+
+std::vector<LivenessResult> LivenessDetector::run_liveness_check(const std::vector<Frame>& frames,
+                                                                 const std::vector<FaceDetectionResult>& faces) {
+    std::vector<LivenessResult> results(faces.size());
+    if (frames.size() != faces.size()) {
+        std::cerr << "[Liveness] ERROR: " << frames.size() << " frames for " << faces.size() << " faces" << std::endl;
+        return results;
     }
-    
-    std::vector<float> probs_sum(3, 0.0f);
-    
-    int session_count = 0;
-    for (const auto& session : liveness_sessions) {
-        
-        // Preprocess face crop with bounding box
-        cv::Mat padded = preprocess_liveness_crop(input_image, face, MODEL_INPUT_SIZE, scales[session_count]);
-        if (padded.empty()) {
-            std::cerr << "[Liveness] Preprocessing failed, skipping liveness check." << std::endl;
-            return lr;
-        }
-        
-//            cv::imshow("input_image", input_image);
-//            cv::imshow("padded" + std::to_string(session_count), padded);
-//            cv::waitKey();
-
-        // Convert to CHW float32 [1,3,80,80]
-        padded.convertTo(padded, CV_32F);
-        std::vector<cv::Mat> channels(3);
-        cv::split(padded, channels);
-        std::vector<float> input_tensor;
-        for (int i = 0; i < 3; ++i) {
-            input_tensor.insert(input_tensor.end(),
-                (float*)channels[i].datastart,
-                (float*)channels[i].dataend
-            );
+    run_liveness_check(frames.data(), faces.data(), faces.size(), results.data());
+    return results;
+}
+
+// Runs members [first_member, first_member + member_count) on one model, batched when the model allows
+// it, otherwise one Run per face. Every member's crop of a face is sampled straight from the frame into
+// its slot of the bound [N,3,H,W] input: only the bilinear taps are read, the crop is never converted
+// or resized as an image. Writes the softmax "real" probability of face n for member m into real_probs[m][n].
+void LivenessDetector::run_members(ModelSession& model, size_t first_member, size_t member_count, const Frame* frames,
+                                   const FaceDetectionResult* faces, size_t count,
+                                   std::vector<float>* real_probs, std::vector<uint8_t>* valid) const {
+    ModelSession::Lease run = model.acquire();
+
+    const size_t run_size = model.dynamic_batch() ? count : 1;
+    run->bind(static_cast<int64_t>(run_size));
+    for (size_t first = 0; first < count; first += run_size) {
+        for (size_t k = 0; k < run_size; ++k) {
+            size_t n = first + k;
+            for (size_t i = 0; i < member_count; ++i) {
+                size_t m = first_member + i;
+                const cv::Size& input_size = member_sizes[m];
+                cv::Rect crop;
+                if (!liveness_crop_rect(frames[n], faces[n], crop_scales[m], crop) ||
+                    !resize_to_tensor(frames[n], crop, input_size, input_size, input_norm,
+                                      run->input(i) + k * 3 * input_size.area())) {
+                    std::cerr << "[Liveness] Preprocessing failed, skipping liveness check." << std::endl;
+                    valid[m][n] = 0;
+                }
+            }
         }
-        
-        // Create tensor
-        Ort::MemoryInfo mem_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-        std::vector<int64_t> input_shape = {1, 3, MODEL_INPUT_SIZE, MODEL_INPUT_SIZE};
-        Ort::Value input_tensor_ort = Ort::Value::CreateTensor<float>(
-                                                                      mem_info, input_tensor.data(), input_tensor.size(), input_shape.data(), input_shape.size()
-                                                                      );
-        
+
         // Run inference
-        std::vector<const char*> input_names = {liveness_input_names.at(session_count).c_str()};
-        Ort::AllocatorWithDefaultOptions allocator;
-        Ort::AllocatedStringPtr output_name = session->GetOutputNameAllocated(0, allocator);
-        std::vector<const char*> output_names = {output_name.get()};
-        
-        auto output_tensors = session->Run(Ort::RunOptions{nullptr}, input_names.data(), &input_tensor_ort, 1, output_names.data(), 1);
-        float* output_data = output_tensors[0].GetTensorMutableData<float>();
-        
+        run->run(Ort::RunOptions{nullptr});
+
         // Apply softmax per model
-        std::vector<float> exp_logits(3);
-        float sum_exp = 0.0f;
-        for (int i = 0; i < 3; ++i) {
-            exp_logits[i] = std::exp(output_data[i]);
-            sum_exp += exp_logits[i];
+        for (size_t i = 0; i < member_count; ++i) {
+            const float* output_data = run->output(i);
+            const size_t classes = run->output_row_size(i);
+            if (static_cast<size_t>(real_class) >= classes) {
+                std::cerr << "[Liveness] Real class " << real_class << " out of " << classes << " classes." << std::endl;
+                valid[first_member + i].assign(valid[first_member + i].size(), 0);
+                continue;
+            }
+            for (size_t k = 0; k < run_size; ++k) {
+                const float* logits = output_data + k * classes;
+                float sum_exp = 0.0f;
+                for (size_t c = 0; c < classes; ++c) {
+                    sum_exp += std::exp(logits[c]);
+                }
+                real_probs[first_member + i][first + k] = std::exp(logits[real_class]) / sum_exp;
+            }
         }
-        for (int i = 0; i < 3; ++i) {
-            probs_sum[i] += exp_logits[i] / sum_exp;
-        }
-        session_count++;
     }
+}
+
+void LivenessDetector::run_liveness_check(const Frame* frames, const FaceDetectionResult* faces, size_t count,
+                                          LivenessResult* results) {
+    std::shared_lock<std::shared_mutex> lock(liveness_mutex);
+    std::fill(results, results + count, LivenessResult());
     
-    
-    float real_score = probs_sum[1] / 2.0f;
-    lr.score = real_score;
-    lr.isLive = real_score > liveness_thresh;
-    
-    std::cout << "[Liveness] Score: " << real_score << std::endl;
-    
-    return lr;
+    if (liveness_models.empty()) {
+        std::cerr << "[Liveness] ERROR: no valid sessions" << std::endl;
+        return;
+    }
+    if (count == 0) return;
+
+    // Per-face bookkeeping is kept per calling thread, it only grows with the batch size
+    const size_t member_count = crop_scales.size();
+    thread_local std::vector<std::vector<uint8_t>> valid;
+    thread_local std::vector<std::vector<float>> real_probs;
+    valid.resize(member_count);
+    real_probs.resize(member_count);
+    for (size_t m = 0; m < member_count; ++m) {
+        valid[m].assign(count, 1);
+        real_probs[m].assign(count, 0.0f);
+    }
+
+    // Lambdas on the pool would name the pool thread's thread_locals, so they get plain pointers
+    std::vector<float>* probs = real_probs.data();
+    std::vector<uint8_t>* flags = valid.data();
+
+    if (fused_ensemble) {
+        // All crops feed one graph, the whole ensemble is a single Run
+        run_members(*liveness_models[0], 0, member_count, frames, faces, count, probs, flags);
+    } else {
+        auto run_member = [&, probs, flags](size_t m) {
+            run_members(*liveness_models[m], m, 1, frames, faces, count, probs, flags);
+        };
+
+        if (member_pool) {
+            // Members 1.. run on the pool while member 0 runs on the calling thread
+            std::vector<std::future<void>> others;
+            for (size_t m = 1; m < member_count; ++m) {
+                others.push_back(member_pool->submit([&run_member, m]() { run_member(m); }));
+            }
+            try {
+                run_member(0);
+            } catch (...) {
+                for (auto& other : others) other.wait();
+                throw;
+            }
+            for (auto& other : others) other.get();
+        } else {
+            for (size_t m = 0; m < member_count; ++m) {
+                run_member(m);
+            }
+        }
+    }
+
+    for (size_t n = 0; n < count; ++n) {
+        float real_score = 0.0f;
+        bool all_valid = true;
+        for (size_t m = 0; m < member_count; ++m) {
+            all_valid = all_valid && valid[m][n];
+            real_score += real_probs[m][n];
+        }
+        if (!all_valid) continue;
+        real_score /= member_count;
+        results[n].score = real_score;
+        results[n].isLive = real_score > liveness_thresh;
+        
+        std::cout << "[Liveness] Score: " << real_score << std::endl;
+    }
+}
+
+void LivenessDetector::release() {
+    std::lock_guard<std::shared_mutex> lock(liveness_mutex);
+    liveness_models.clear();
+    member_pool.reset();
 }
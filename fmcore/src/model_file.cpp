@@ -0,0 +1,92 @@
+#include "model_file.h"
+#include <fstream>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+ModelSource modelFromMemory(const void* data, size_t size) {
+    ModelSource source;
+    source.data = data;
+    source.size = size;
+    return source;
+}
+
+ModelSource modelFromFd(int fd, int64_t offset, size_t size) {
+    ModelSource source;
+    source.fd = fd;
+    source.offset = offset;
+    source.size = size;
+    return source;
+}
+
+struct ModelFile::Source {
+    ModelSource range;
+    ~Source() {
+#ifndef _WIN32
+        if (range.fd >= 0) close(range.fd);
+#endif
+    }
+};
+
+ModelFile::View::~View() {
+#ifndef _WIN32
+    if (mapping) munmap(mapping, mapping_size);
+#endif
+}
+
+ModelFile::ModelFile(const std::string& path) : model_name(path) {}
+
+ModelFile::ModelFile(const std::string& name, const ModelSource& model) : model_name(name) {
+    auto owned = std::make_shared<Source>();
+    owned->range = model;
+    if (model.fd >= 0) {
+#ifndef _WIN32
+        // The caller may close its descriptor (e.g. an AssetFileDescriptor) once init returns
+        owned->range.fd = dup(model.fd);
+        if (owned->range.fd < 0) {
+            std::cerr << "[ModelFile] Failed to duplicate the descriptor of " << name << std::endl;
+        }
+#else
+        owned->range.fd = -1;
+        std::cerr << "[ModelFile] File descriptor sources are not supported on this platform." << std::endl;
+#endif
+    }
+    source = owned;
+}
+
+bool ModelFile::available() const {
+    if (is_path()) return std::ifstream(model_name).good();
+    return source->range.size > 0 && (source->range.data || source->range.fd >= 0);
+}
+
+bool ModelFile::map(View& view) const {
+    if (is_path() || !available()) return false;
+    const ModelSource& range = source->range;
+    if (range.data) {
+        view.bytes = range.data;
+        view.length = range.size;
+        return true;
+    }
+
+#ifndef _WIN32
+    // mmap offsets have to be page aligned, the range starts somewhere inside the first page
+    const int64_t page = sysconf(_SC_PAGESIZE);
+    const int64_t aligned = range.offset / page * page;
+    const size_t lead = static_cast<size_t>(range.offset - aligned);
+    void* mapping = mmap(nullptr, range.size + lead, PROT_READ, MAP_PRIVATE, range.fd, static_cast<off_t>(aligned));
+    if (mapping == MAP_FAILED) {
+        std::cerr << "[ModelFile] Failed to map " << model_name << std::endl;
+        return false;
+    }
+    view.mapping = mapping;
+    view.mapping_size = range.size + lead;
+    view.bytes = static_cast<const char*>(mapping) + lead;
+    view.length = range.size;
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,406 @@
+#include "ort_session.h"
+#include <onnxruntime_session_options_config_keys.h>
+#include <opencv2/core/utility.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Inference concurrency comes from the callers (process() threads, pipeline stages, branches),
+// so by default the global pools add no workers of their own and every Run executes on its
+// calling thread. config.json can size them for machines with cores to spare.
+std::mutex env_mutex;
+OrtSettings env_settings;
+// Set by the first configure_ort_env (or by ort_env() if nothing configured it), the settings are frozen from then on
+bool env_configured = false;
+// False if the shared arena couldn't be registered, sessions then keep their own
+bool env_arena = false;
+// BoundRun::run calls in progress on this thread
+thread_local int runs_on_thread = 0;
+
+bool same_env_settings(const OrtSettings& a, const OrtSettings& b) {
+    return a.intra_op_threads == b.intra_op_threads && a.inter_op_threads == b.inter_op_threads &&
+           a.allow_spinning == b.allow_spinning && a.arena_extend_strategy == b.arena_extend_strategy &&
+           a.arena_max_mem == b.arena_max_mem;
+}
+
+// 64-bit FNV-1a over 8-byte words, the models are hashed on every init so it has to keep up with disk reads
+class ContentHash {
+public:
+    void update(const char* data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, data + i, 8);
+            mix(word);
+        }
+        for (; i < size; ++i) mix(static_cast<unsigned char>(data[i]));
+    }
+    void update(const std::string& text) { update(text.data(), text.size()); }
+    uint64_t value() const { return hash; }
+
+private:
+    void mix(uint64_t word) { hash = (hash ^ word) * 0x100000001b3ULL; }
+    uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+bool hash_file(const std::string& path, ContentHash& hash) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::vector<char> buffer(1 << 20);
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        hash.update(buffer.data(), static_cast<size_t>(file.gcount()));
+    }
+    return file.eof();
+}
+
+// Everything an optimized graph depends on besides the model and the ORT build: the execution
+// provider, every session option make_session_options sets and the CPU features ORT's kernels
+// and layout transformations are picked for
+std::string optimization_context(const OrtSettings& settings) {
+    std::ostringstream context;
+    context << "CPUExecutionProvider"
+            << "|opt=" << static_cast<int>(settings.optimization)
+            << "|mode=" << static_cast<int>(settings.execution_mode)
+            << "|mem_pattern=" << settings.memory_pattern
+            << "|arena=" << settings.cpu_arena
+            << "|own_threads=" << settings.own_threads;
+    if (settings.own_threads) {
+        context << "|intra=" << settings.intra_op_threads << "|inter=" << settings.inter_op_threads
+                << "|spin=" << settings.allow_spinning;
+    }
+    context << "|cpu=";
+    for (int feature = 1; feature < CV_HARDWARE_MAX_FEATURE; ++feature) {
+        if (cv::checkHardwareSupport(feature)) context << feature << ",";
+    }
+    return context.str();
+}
+
+// Length of a key in an artifact name, 16 hex digits
+constexpr size_t kArtifactKeySize = 16;
+
+std::string artifact_key(uint64_t value) {
+    std::ostringstream key;
+    key << std::hex << std::setw(kArtifactKeySize) << std::setfill('0') << value;
+    return key.str();
+}
+
+// <dir>/<model stem>.<source key>.<options key>.ort, or an empty path if the model can't be read or
+// an in-memory model has no cache directory. The source key covers the model's bytes and the ORT
+// build, the options key everything else the optimized graph depends on.
+std::filesystem::path cache_artifact(const ModelFile& model, const ModelFile::View& bytes, const OrtSettings& settings) {
+    if (!model.is_path() && settings.model_cache_dir.empty()) return {};
+    ContentHash source;
+    if (model.is_path()) {
+        if (!hash_file(model.name(), source)) return {};
+    } else {
+        source.update(static_cast<const char*>(bytes.data()), bytes.size());
+    }
+    source.update(Ort::GetVersionString());
+    ContentHash options;
+    options.update(optimization_context(settings));
+
+    const std::string name = std::filesystem::path(model.name()).stem().string() + "." + artifact_key(source.value()) +
+                             "." + artifact_key(options.value()) + ".ort";
+    std::filesystem::path dir = settings.model_cache_dir.empty()
+                                    ? std::filesystem::path(model.name()).parent_path()
+                                    : std::filesystem::path(settings.model_cache_dir);
+    return dir / name;
+}
+
+// Removes artifacts of an older version of the model or of another ORT build. Artifacts of the same
+// model saved with other options are kept, they belong to other FMCore configurations.
+void remove_stale_artifacts(const std::filesystem::path& artifact, const std::string& model_path) {
+    const std::string prefix = std::filesystem::path(model_path).stem().string() + ".";
+    const std::string keep = artifact.filename().string();
+    const std::string source_key = keep.substr(prefix.size(), kArtifactKeySize);
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(artifact.parent_path(), error)) {
+        const std::string name = entry.path().filename().string();
+        const bool same_model = name.size() == keep.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+                                entry.path().extension() == ".ort";
+        if (same_model && name.compare(prefix.size(), kArtifactKeySize, source_key) != 0) {
+            std::filesystem::remove(entry.path(), error);
+        }
+    }
+}
+
+// <artifact>.<pid>.<thread>.<n>.partial, unique to this save so concurrent inits of the same
+// model (other processes or FMCore instances) never write into each other's file
+std::filesystem::path partial_artifact(const std::filesystem::path& artifact) {
+    static std::atomic<unsigned> saves(0);
+#ifndef _WIN32
+    const long pid = static_cast<long>(getpid());
+#else
+    const long pid = 0;
+#endif
+    std::ostringstream suffix;
+    suffix << "." << pid << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id())
+           << "." << saves++ << ".partial";
+    std::filesystem::path partial = artifact;
+    partial += suffix.str();
+    return partial;
+}
+
+size_t element_count(const std::vector<int64_t>& shape) {
+    return std::accumulate(shape.begin(), shape.end(), static_cast<size_t>(1),
+                           [](size_t total, int64_t dim) { return total * static_cast<size_t>(dim); });
+}
+
+} // namespace
+
+bool configure_ort_env(const OrtSettings& settings) {
+    std::lock_guard<std::mutex> lock(env_mutex);
+    if (env_configured) {
+        return same_env_settings(settings, env_settings);
+    }
+    env_settings = settings;
+    env_configured = true;
+    return true;
+}
+
+Ort::Env& ort_env() {
+    static Ort::Env env = []() {
+        std::lock_guard<std::mutex> lock(env_mutex);
+        env_configured = true;
+
+        Ort::ThreadingOptions threading;
+        threading.SetGlobalIntraOpNumThreads(env_settings.intra_op_threads);
+        threading.SetGlobalInterOpNumThreads(env_settings.inter_op_threads);
+        threading.SetGlobalSpinControl(env_settings.allow_spinning ? 1 : 0);
+        Ort::Env shared(threading, ORT_LOGGING_LEVEL_WARNING, "FMCore");
+
+        // One arena for all sessions instead of one per session
+        Ort::MemoryInfo mem_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        Ort::ArenaCfg arena(env_settings.arena_max_mem, env_settings.arena_extend_strategy, -1, -1);
+        try {
+            shared.CreateAndRegisterAllocator(mem_info, arena);
+            env_arena = true;
+        } catch (const Ort::Exception& e) {
+            std::cerr << "[ORT] Shared arena unavailable, each session uses its own: " << e.what() << std::endl;
+        }
+        return shared;
+    }();
+    return env;
+}
+
+Ort::SessionOptions make_session_options(const OrtSettings& settings) {
+    Ort::SessionOptions options;
+    options.SetGraphOptimizationLevel(settings.optimization);
+    options.SetExecutionMode(settings.execution_mode);
+    if (!settings.memory_pattern) options.DisableMemPattern();
+
+    if (settings.own_threads) {
+        options.SetIntraOpNumThreads(settings.intra_op_threads);
+        options.SetInterOpNumThreads(settings.inter_op_threads);
+        const char* spinning = settings.allow_spinning ? "1" : "0";
+        options.AddConfigEntry(kOrtSessionOptionsConfigAllowIntraOpSpinning, spinning);
+        options.AddConfigEntry(kOrtSessionOptionsConfigAllowInterOpSpinning, spinning);
+    } else {
+        options.DisablePerSessionThreads();
+    }
+
+    if (!settings.cpu_arena) {
+        options.DisableCpuMemArena();
+    } else {
+        // The session keeps its own arena if the shared one couldn't be registered
+        ort_env();
+        if (env_arena) options.AddConfigEntry(kOrtSessionOptionsConfigUseEnvAllocators, "1");
+    }
+    return options;
+}
+
+std::unique_ptr<Ort::Session> create_session(const ModelFile& model, const OrtSettings& settings) {
+    // In-memory sources are parsed straight from their bytes, an fd range is mapped only until
+    // the session exists since ORT keeps no reference to the buffer
+    ModelFile::View bytes;
+    if (!model.is_path() && !model.map(bytes)) {
+        throw Ort::Exception("Model source unavailable: " + model.name(), ORT_NO_SUCHFILE);
+    }
+    auto open = [&](const Ort::SessionOptions& options) {
+        if (model.is_path()) {
+            return std::make_unique<Ort::Session>(ort_env(), model.name().c_str(), options);
+        }
+        return std::make_unique<Ort::Session>(ort_env(), bytes.data(), bytes.size(), options);
+    };
+
+    Ort::SessionOptions options = make_session_options(settings);
+    if (!settings.model_cache) {
+        return open(options);
+    }
+
+    const std::filesystem::path artifact = cache_artifact(model, bytes, settings);
+    if (artifact.empty()) {
+        return open(options);
+    }
+    std::error_code error;
+    if (std::filesystem::exists(artifact, error)) {
+        try {
+            return std::make_unique<Ort::Session>(ort_env(), artifact.c_str(), options);
+        } catch (const Ort::Exception& e) {
+            std::cerr << "[ORT] Discarding unreadable model cache " << artifact << ": " << e.what() << std::endl;
+            std::filesystem::remove(artifact, error);
+        }
+    }
+
+    // Optimize from the source model and save the result under a temporary name of our own, so a
+    // crash or a concurrent init never leaves a partial artifact behind the final name. The rename
+    // is atomic, the last complete save wins.
+    const std::filesystem::path partial = partial_artifact(artifact);
+    Ort::SessionOptions saving = make_session_options(settings);
+    saving.SetOptimizedModelFilePath(partial.c_str());
+    saving.AddConfigEntry(kOrtSessionOptionsConfigSaveModelFormat, "ORT");
+    try {
+        auto session = open(saving);
+        std::filesystem::rename(partial, artifact, error);
+        if (error) {
+            std::cerr << "[ORT] Failed to store model cache " << artifact << ": " << error.message() << std::endl;
+            std::filesystem::remove(partial, error);
+        } else {
+            remove_stale_artifacts(artifact, model.name());
+            std::cout << "[ORT] Saved optimized model: " << artifact << std::endl;
+        }
+        return session;
+    } catch (const Ort::Exception& e) {
+        // e.g. a read-only model directory, the model still loads without the cache
+        std::cerr << "[ORT] Model cache disabled for " << model.name() << ": " << e.what() << std::endl;
+        std::filesystem::remove(partial, error);
+        return open(options);
+    }
+}
+
+SessionIO describe_session(const Ort::Session& session) {
+    SessionIO io;
+    Ort::AllocatorWithDefaultOptions allocator;
+    for (size_t i = 0; i < session.GetInputCount(); ++i) {
+        io.input_names.push_back(session.GetInputNameAllocated(i, allocator).get());
+        io.input_shapes.push_back(session.GetInputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape());
+    }
+    for (size_t i = 0; i < session.GetOutputCount(); ++i) {
+        io.output_names.push_back(session.GetOutputNameAllocated(i, allocator).get());
+        io.output_shapes.push_back(session.GetOutputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape());
+    }
+    return io;
+}
+
+BoundRun::BoundRun(Ort::Session& session, const SessionIO& io)
+    : session(session),
+      io(io),
+      mem_info(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU)),
+      binding(session),
+      inputs(io.input_names.size()),
+      outputs(io.output_names.size()),
+      output_rows(io.output_names.size(), 0),
+      ort_allocated(io.output_names.size(), false) {}
+
+void BoundRun::bind(int64_t batch) {
+    if (batch == bound_batch) return;
+    binding.ClearBoundInputs();
+    binding.ClearBoundOutputs();
+
+    for (size_t i = 0; i < io.input_names.size(); ++i) {
+        std::vector<int64_t> shape = io.input_shapes[i];
+        if (!shape.empty()) shape[0] = batch;
+        inputs[i].assign(element_count(shape), 0.0f);
+        Ort::Value value = Ort::Value::CreateTensor<float>(mem_info, inputs[i].data(), inputs[i].size(),
+                                                           shape.data(), shape.size());
+        binding.BindInput(io.input_names[i].c_str(), value);
+    }
+
+    for (size_t i = 0; i < io.output_names.size(); ++i) {
+        std::vector<int64_t> shape = io.output_shapes[i];
+        if (!shape.empty()) shape[0] = batch;
+        ort_allocated[i] = std::any_of(shape.begin(), shape.end(), [](int64_t dim) { return dim < 0; });
+        if (ort_allocated[i]) {
+            binding.BindOutput(io.output_names[i].c_str(), mem_info);
+            continue;
+        }
+        outputs[i].assign(element_count(shape), 0.0f);
+        output_rows[i] = outputs[i].size() / static_cast<size_t>(batch);
+        Ort::Value value = Ort::Value::CreateTensor<float>(mem_info, outputs[i].data(), outputs[i].size(),
+                                                           shape.data(), shape.size());
+        binding.BindOutput(io.output_names[i].c_str(), value);
+    }
+    bound_batch = batch;
+}
+
+int BoundRun::in_progress() {
+    return runs_on_thread;
+}
+
+void BoundRun::run(const Ort::RunOptions& options) {
+    struct RunScope {
+        RunScope() { ++runs_on_thread; }
+        ~RunScope() { --runs_on_thread; }
+    } scope;
+    session.Run(options, binding);
+    if (std::find(ort_allocated.begin(), ort_allocated.end(), true) == ort_allocated.end()) return;
+
+    // Only models with symbolic output sizes take this path
+    ort_outputs = binding.GetOutputValues();
+    for (size_t i = 0; i < ort_outputs.size(); ++i) {
+        if (ort_allocated[i]) {
+            output_rows[i] = ort_outputs[i].GetTensorTypeAndShapeInfo().GetElementCount() / static_cast<size_t>(bound_batch);
+        }
+    }
+}
+
+const float* BoundRun::output(size_t index) const {
+    return ort_allocated[index] ? ort_outputs[index].GetTensorData<float>() : outputs[index].data();
+}
+
+size_t BoundRun::output_row_size(size_t index) const {
+    return output_rows[index];
+}
+
+ModelSession::ModelSession(std::unique_ptr<Ort::Session> session)
+    : ort_session(std::move(session)), session_io(describe_session(*ort_session)) {}
+
+bool ModelSession::dynamic_batch() const {
+    const auto& shapes = session_io.input_shapes;
+    return !shapes.empty() && !shapes[0].empty() && shapes[0][0] < 0;
+}
+
+bool ModelSession::resolve_image_input(size_t index, int fallback_size, int& height, int& width) {
+    if (index >= session_io.input_shapes.size()) return false;
+    const std::vector<int64_t>& shape = session_io.input_shapes[index];
+    if (shape.size() != 4 || (shape[1] > 0 && shape[1] != 3)) return false;
+    height = shape[2] > 0 ? static_cast<int>(shape[2]) : fallback_size;
+    width = shape[3] > 0 ? static_cast<int>(shape[3]) : fallback_size;
+    if (height <= 0 || width <= 0) return false;
+    set_input_shape(index, {shape[0] < 0 ? -1 : 1, 3, height, width});
+    return true;
+}
+
+ModelSession::Lease ModelSession::acquire() {
+    std::unique_ptr<BoundRun> run;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        if (!idle_runs.empty()) {
+            run = std::move(idle_runs.back());
+            idle_runs.pop_back();
+        }
+    }
+    if (!run) run = std::make_unique<BoundRun>(*ort_session, session_io);
+    return Lease(*this, std::move(run));
+}
+
+void ModelSession::give_back(std::unique_ptr<BoundRun> run) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    idle_runs.push_back(std::move(run));
+}
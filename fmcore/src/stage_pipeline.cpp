@@ -0,0 +1,52 @@
+#include "stage_pipeline.h"
+#include <exception>
+#include <iostream>
+
+StagePipeline::StagePipeline(std::vector<Stage> stages, size_t queue_depth) : stages(std::move(stages)) {
+    for (size_t i = 0; i < this->stages.size(); ++i) {
+        queues.push_back(std::make_unique<BoundedQueue<std::unique_ptr<PipelineJob>>>(queue_depth));
+    }
+    for (size_t i = 0; i < this->stages.size(); ++i) {
+        workers.emplace_back(&StagePipeline::run_stage, this, i);
+    }
+}
+
+StagePipeline::~StagePipeline() {
+    // Closing the first queue lets every stage drain and close the next one in turn
+    if (!queues.empty()) queues.front()->close();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool StagePipeline::submit(std::unique_ptr<PipelineJob> job) {
+    if (!queues.empty() && queues.front()->push(std::move(job))) return true;
+    // A rejected job is still answered, with an empty result
+    if (job->done) job->done(ProcessResult());
+    return false;
+}
+
+void StagePipeline::run_stage(size_t index) {
+    auto& input = *queues[index];
+    bool last = index + 1 == stages.size();
+
+    std::unique_ptr<PipelineJob> job;
+    while (input.pop(job)) {
+        bool forward = false;
+        try {
+            forward = stages[index](*job);
+        } catch (const std::exception& e) {
+            std::cerr << "[Pipeline] Stage " << index << " failed: " << e.what() << std::endl;
+            job->result = ProcessResult();
+        }
+
+        if (forward && !last) {
+            queues[index + 1]->push(std::move(job));
+        } else if (job->done) {
+            job->done(std::move(job->result));
+        }
+        job.reset();
+    }
+
+    if (!last) queues[index + 1]->close();
+}
@@ -0,0 +1,454 @@
+#include "tensor_kernels.h"
+#include "frame.h"
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+// Scratch buffers grown on first use, so steady-state calls don't allocate
+struct ResizeScratch {
+    // Horizontal taps of each output value, as indices into source (per channel for packed formats)
+    std::vector<int> x0;
+    std::vector<int> x1;
+    std::vector<float> wx;
+    // The roi span of one source row as floats
+    std::vector<float> source;
+    std::vector<float> rows;
+    std::vector<float> chroma;
+};
+
+ResizeScratch& resize_scratch() {
+    thread_local ResizeScratch scratch;
+    return scratch;
+}
+
+struct WarpScratch {
+    // Per output pixel of the current row: clamped source columns and rows of the taps, and weights
+    std::vector<int> x0;
+    std::vector<int> x1;
+    std::vector<int> y0;
+    std::vector<int> y1;
+    std::vector<float> wx;
+    std::vector<float> wy;
+    // Top-left, top-right, bottom-left and bottom-right taps of each channel, planar
+    std::vector<float> taps;
+    // Luma after interpolation and the nearest chroma, for YUV frames
+    std::vector<float> luma;
+    std::vector<float> u;
+    std::vector<float> v;
+};
+
+WarpScratch& warp_scratch() {
+    thread_local WarpScratch scratch;
+    return scratch;
+}
+
+// Source coordinate of output index o, clamped to [first, last] like cv::resize's border handling
+inline float source_coord(int o, float step, int first, int last) {
+    float s = first + (o + 0.5f) * step - 0.5f;
+    return std::min(static_cast<float>(last), std::max(static_cast<float>(first), s));
+}
+
+// out[i] = (a[i] + (b[i] - a[i]) * wy - mean) * scale
+void blend_rows(const float* a, const float* b, float wy, const TensorNorm& norm, float* out, int n) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vwy = cv::vx_setall_f32(wy);
+    const cv::v_float32 vmean = cv::vx_setall_f32(norm.mean);
+    const cv::v_float32 vscale = cv::vx_setall_f32(norm.scale);
+    for (; i <= n - lanes; i += lanes) {
+        cv::v_float32 va = cv::vx_load(a + i);
+        cv::v_float32 vb = cv::vx_load(b + i);
+        cv::v_float32 v = cv::v_fma(cv::v_sub(vb, va), vwy, va);
+        cv::v_store(out + i, cv::v_mul(cv::v_sub(v, vmean), vscale));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = (a[i] + (b[i] - a[i]) * wy - norm.mean) * norm.scale;
+    }
+}
+
+// Blends two rows of luma, converts with the chroma of the output row and writes three planes
+void blend_yuv_rows(const float* a, const float* b, float wy, const float* u, const float* v,
+                    const YuvCoeffs& c, const TensorNorm& norm, float* r_out, float* g_out, float* b_out, int n) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vwy = cv::vx_setall_f32(wy);
+    const cv::v_float32 voff = cv::vx_setall_f32(c.yOffset);
+    const cv::v_float32 vys = cv::vx_setall_f32(c.yScale);
+    const cv::v_float32 vrv = cv::vx_setall_f32(c.rv);
+    const cv::v_float32 vgu = cv::vx_setall_f32(c.gu);
+    const cv::v_float32 vgv = cv::vx_setall_f32(c.gv);
+    const cv::v_float32 vbu = cv::vx_setall_f32(c.bu);
+    const cv::v_float32 vzero = cv::vx_setzero_f32();
+    const cv::v_float32 vmax = cv::vx_setall_f32(255.0f);
+    const cv::v_float32 vmean = cv::vx_setall_f32(norm.mean);
+    const cv::v_float32 vscale = cv::vx_setall_f32(norm.scale);
+    for (; i <= n - lanes; i += lanes) {
+        cv::v_float32 va = cv::vx_load(a + i);
+        cv::v_float32 vb = cv::vx_load(b + i);
+        cv::v_float32 l = cv::v_mul(cv::v_sub(cv::v_fma(cv::v_sub(vb, va), vwy, va), voff), vys);
+        cv::v_float32 vu = cv::vx_load(u + i);
+        cv::v_float32 vv = cv::vx_load(v + i);
+        cv::v_float32 r = cv::v_fma(vrv, vv, l);
+        cv::v_float32 g = cv::v_sub(cv::v_sub(l, cv::v_mul(vgv, vv)), cv::v_mul(vgu, vu));
+        cv::v_float32 bl = cv::v_fma(vbu, vu, l);
+        r = cv::v_min(cv::v_max(r, vzero), vmax);
+        g = cv::v_min(cv::v_max(g, vzero), vmax);
+        bl = cv::v_min(cv::v_max(bl, vzero), vmax);
+        cv::v_store(r_out + i, cv::v_mul(cv::v_sub(r, vmean), vscale));
+        cv::v_store(g_out + i, cv::v_mul(cv::v_sub(g, vmean), vscale));
+        cv::v_store(b_out + i, cv::v_mul(cv::v_sub(bl, vmean), vscale));
+    }
+#endif
+    for (; i < n; ++i) {
+        float l = (a[i] + (b[i] - a[i]) * wy - c.yOffset) * c.yScale;
+        float r = std::min(255.0f, std::max(0.0f, l + c.rv * v[i]));
+        float g = std::min(255.0f, std::max(0.0f, l - c.gv * v[i] - c.gu * u[i]));
+        float bl = std::min(255.0f, std::max(0.0f, l + c.bu * u[i]));
+        r_out[i] = (r - norm.mean) * norm.scale;
+        g_out[i] = (g - norm.mean) * norm.scale;
+        b_out[i] = (bl - norm.mean) * norm.scale;
+    }
+}
+
+// out[i] = row[i] as float
+void expand_row(const uint8_t* row, int n, float* out) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    for (; i <= n - lanes; i += lanes) {
+        cv::v_store(out + i, cv::v_cvt_f32(cv::v_reinterpret_as_s32(cv::vx_load_expand_q(row + i))));
+    }
+#endif
+    for (; i < n; ++i) {
+        out[i] = row[i];
+    }
+}
+
+// out[i] = a + (b - a) * wx[i] with a = source[x0[i]] and b = source[x1[i]], the taps gathered into lanes
+void sample_row(const float* source, const int* x0, const int* x1, const float* wx, int n, float* out) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    for (; i <= n - lanes; i += lanes) {
+        cv::v_float32 va = cv::v_lut(source, cv::vx_load(x0 + i));
+        cv::v_float32 vb = cv::v_lut(source, cv::vx_load(x1 + i));
+        cv::v_store(out + i, cv::v_fma(cv::v_sub(vb, va), cv::vx_load(wx + i), va));
+    }
+#endif
+    for (; i < n; ++i) {
+        float a = source[x0[i]];
+        out[i] = a + (source[x1[i]] - a) * wx[i];
+    }
+}
+
+// Same with the taps read straight from the bytes, for spans much wider than the output where
+// expanding the whole span would cost more than the taps
+void sample_row(const uint8_t* source, const int* x0, const int* x1, const float* wx, int n, float* out) {
+    for (int i = 0; i < n; ++i) {
+        float a = source[x0[i]];
+        out[i] = a + (source[x1[i]] - a) * wx[i];
+    }
+}
+
+// Clamped bilinear taps around s, the same border handling as BORDER_REPLICATE
+inline void replicate_taps(float s, int last, int& i0, int& i1, float& w) {
+    float f = std::floor(s);
+    int i = static_cast<int>(f);
+    w = s - f;
+    i0 = std::min(std::max(i, 0), last);
+    i1 = std::min(std::max(i + 1, 0), last);
+}
+
+// Source taps of the n output pixels of row y, sampled at m * (x, y, 1)
+void warp_row_taps(const cv::Matx23f& m, int y, int n, int last_x, int last_y, WarpScratch& s) {
+    const float row_x = m(0, 1) * y + m(0, 2);
+    const float row_y = m(1, 1) * y + m(1, 2);
+    int x = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    float offsets[cv::VTraits<cv::v_float32>::max_nlanes];
+    for (int k = 0; k < lanes; ++k) offsets[k] = static_cast<float>(k);
+    const cv::v_float32 voffsets = cv::vx_load(offsets);
+    const cv::v_float32 vm00 = cv::vx_setall_f32(m(0, 0));
+    const cv::v_float32 vm10 = cv::vx_setall_f32(m(1, 0));
+    const cv::v_float32 vrow_x = cv::vx_setall_f32(row_x);
+    const cv::v_float32 vrow_y = cv::vx_setall_f32(row_y);
+    const cv::v_int32 vzero = cv::vx_setzero_s32();
+    const cv::v_int32 vone = cv::vx_setall_s32(1);
+    const cv::v_int32 vlast_x = cv::vx_setall_s32(last_x);
+    const cv::v_int32 vlast_y = cv::vx_setall_s32(last_y);
+    for (; x <= n - lanes; x += lanes) {
+        cv::v_float32 vx = cv::v_add(cv::vx_setall_f32(static_cast<float>(x)), voffsets);
+        cv::v_float32 sx = cv::v_fma(vm00, vx, vrow_x);
+        cv::v_float32 sy = cv::v_fma(vm10, vx, vrow_y);
+        cv::v_int32 ix = cv::v_floor(sx);
+        cv::v_int32 iy = cv::v_floor(sy);
+        cv::v_store(s.wx.data() + x, cv::v_sub(sx, cv::v_cvt_f32(ix)));
+        cv::v_store(s.wy.data() + x, cv::v_sub(sy, cv::v_cvt_f32(iy)));
+        cv::v_store(s.x0.data() + x, cv::v_min(cv::v_max(ix, vzero), vlast_x));
+        cv::v_store(s.x1.data() + x, cv::v_min(cv::v_max(cv::v_add(ix, vone), vzero), vlast_x));
+        cv::v_store(s.y0.data() + x, cv::v_min(cv::v_max(iy, vzero), vlast_y));
+        cv::v_store(s.y1.data() + x, cv::v_min(cv::v_max(cv::v_add(iy, vone), vzero), vlast_y));
+    }
+#endif
+    for (; x < n; ++x) {
+        replicate_taps(m(0, 0) * x + row_x, last_x, s.x0[x], s.x1[x], s.wx[x]);
+        replicate_taps(m(1, 0) * x + row_y, last_y, s.y0[x], s.y1[x], s.wy[x]);
+    }
+}
+
+// out[i] = (bilinear blend of the taps a, b (top) and c, d (bottom) - mean) * scale
+void blend_taps(const float* a, const float* b, const float* c, const float* d, const float* wx,
+                const float* wy, const TensorNorm& norm, float* out, int n) {
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vmean = cv::vx_setall_f32(norm.mean);
+    const cv::v_float32 vscale = cv::vx_setall_f32(norm.scale);
+    for (; i <= n - lanes; i += lanes) {
+        cv::v_float32 vwx = cv::vx_load(wx + i);
+        cv::v_float32 va = cv::vx_load(a + i);
+        cv::v_float32 vc = cv::vx_load(c + i);
+        cv::v_float32 top = cv::v_fma(cv::v_sub(cv::vx_load(b + i), va), vwx, va);
+        cv::v_float32 bottom = cv::v_fma(cv::v_sub(cv::vx_load(d + i), vc), vwx, vc);
+        cv::v_float32 v = cv::v_fma(cv::v_sub(bottom, top), cv::vx_load(wy + i), top);
+        cv::v_store(out + i, cv::v_mul(cv::v_sub(v, vmean), vscale));
+    }
+#endif
+    for (; i < n; ++i) {
+        float top = a[i] + (b[i] - a[i]) * wx[i];
+        float bottom = c[i] + (d[i] - c[i]) * wx[i];
+        out[i] = (top + (bottom - top) * wy[i] - norm.mean) * norm.scale;
+    }
+}
+
+} // namespace
+
+bool resize_to_tensor(const Frame& frame, const cv::Rect& roi, const cv::Size& out_size,
+                      const cv::Size& tensor_size, const TensorNorm& norm, float* dst) {
+    cv::Rect src = roi & cv::Rect(0, 0, frame.width, frame.height);
+    const int out_w = std::min(out_size.width, tensor_size.width);
+    const int out_h = std::min(out_size.height, tensor_size.height);
+    if (src.empty() || out_w <= 0 || out_h <= 0 || !validate_frame(frame)) return false;
+
+    const bool yuv = is_yuv_format(frame.format);
+    const int cn = packed_channels(frame.format);
+    const bool bgr_order = frame.format == PixelFormat::BGR || frame.format == PixelFormat::BGRA;
+    const int order[3] = {bgr_order ? 2 : 0, 1, bgr_order ? 0 : 2};
+    const size_t plane = static_cast<size_t>(tensor_size.width) * tensor_size.height;
+    const float pad = (0.0f - norm.mean) * norm.scale;
+
+    // Horizontal taps are the same for every row: indices into the roi span of a source row, one
+    // set per channel in RGB order for packed formats (luma only for YUV)
+    ResizeScratch& s = resize_scratch();
+    const int channels = yuv ? 1 : 3;
+    const int row_len = channels * out_w;
+    s.x0.resize(row_len);
+    s.x1.resize(row_len);
+    s.wx.resize(out_w);
+    const float fx = static_cast<float>(src.width) / out_w;
+    const float fy = static_cast<float>(src.height) / out_h;
+    const int last_x = src.x + src.width - 1;
+    const int last_y = src.y + src.height - 1;
+    const int step = yuv ? 1 : cn;
+    for (int x = 0; x < out_w; ++x) {
+        float sx = source_coord(x, fx, src.x, last_x);
+        int x0 = static_cast<int>(sx);
+        int x1 = std::min(x0 + 1, last_x);
+        s.wx[x] = sx - x0;
+        for (int c = 0; c < channels; ++c) {
+            int k = yuv ? 0 : order[c];
+            s.x0[c * out_w + x] = (x0 - src.x) * step + k;
+            s.x1[c * out_w + x] = (x1 - src.x) * step + k;
+        }
+    }
+    // Expanding the span lets the taps be gathered into vector lanes, which stops paying off once
+    // most of the span is skipped (downscaling by about 3x or more)
+    const bool expand = src.width * step <= 3 * row_len;
+    if (expand) s.source.resize(static_cast<size_t>(src.width) * step);
+
+    // Two cached source rows, each 3 planar channels (or luma only for YUV)
+    s.rows.resize(2 * static_cast<size_t>(row_len));
+    float* rows[2] = {s.rows.data(), s.rows.data() + row_len};
+    int cached[2] = {-1, -1};
+    if (yuv) s.chroma.resize(2 * static_cast<size_t>(out_w));
+    float* u_row = yuv ? s.chroma.data() : nullptr;
+    float* v_row = yuv ? s.chroma.data() + out_w : nullptr;
+    const YuvCoeffs& coeffs = yuv_coeffs(frame);
+
+    auto source_row = [&](int y, int slot) {
+        if (cached[slot] == y) return;
+        // When upscaling the previous bottom row becomes the new top row
+        if (slot == 0 && cached[1] == y) {
+            std::swap(rows[0], rows[1]);
+            std::swap(cached[0], cached[1]);
+            return;
+        }
+        const uint8_t* row = frame.planes[0].data + static_cast<size_t>(y) * frame.planes[0].rowStride +
+                             static_cast<size_t>(src.x) * step;
+        if (expand) expand_row(row, src.width * step, s.source.data());
+        for (int c = 0; c < channels; ++c) {
+            const int* x0 = s.x0.data() + c * out_w;
+            const int* x1 = s.x1.data() + c * out_w;
+            if (expand) {
+                sample_row(s.source.data(), x0, x1, s.wx.data(), out_w, rows[slot] + c * out_w);
+            } else {
+                sample_row(row, x0, x1, s.wx.data(), out_w, rows[slot] + c * out_w);
+            }
+        }
+        cached[slot] = y;
+    };
+
+    for (int oy = 0; oy < out_h; ++oy) {
+        float sy = source_coord(oy, fy, src.y, last_y);
+        int y0 = static_cast<int>(sy);
+        int y1 = std::min(y0 + 1, last_y);
+        float wy = sy - y0;
+        source_row(y0, 0);
+        source_row(y1, 1);
+
+        float* r_out = dst + static_cast<size_t>(oy) * tensor_size.width;
+        float* g_out = r_out + plane;
+        float* b_out = g_out + plane;
+        if (yuv) {
+            // Nearest 4:2:0 chroma sample for every output pixel of this row
+            const FramePlane& up = frame.planes[1];
+            const FramePlane& vp = frame.planes[2];
+            const size_t chroma_y = static_cast<size_t>(std::min(static_cast<int>(sy + 0.5f), last_y) / 2);
+            const uint8_t* u_src = up.data + chroma_y * up.rowStride;
+            const uint8_t* v_src = vp.data + chroma_y * vp.rowStride;
+            for (int x = 0; x < out_w; ++x) {
+                int cx = std::min(src.x + s.x0[x] + (s.wx[x] >= 0.5f ? 1 : 0), last_x) / 2;
+                u_row[x] = u_src[cx * up.pixelStride] - 128.0f;
+                v_row[x] = v_src[cx * vp.pixelStride] - 128.0f;
+            }
+            blend_yuv_rows(rows[0], rows[1], wy, u_row, v_row, coeffs, norm, r_out, g_out, b_out, out_w);
+        } else {
+            blend_rows(rows[0], rows[1], wy, norm, r_out, out_w);
+            blend_rows(rows[0] + out_w, rows[1] + out_w, wy, norm, g_out, out_w);
+            blend_rows(rows[0] + 2 * out_w, rows[1] + 2 * out_w, wy, norm, b_out, out_w);
+        }
+
+        // Letterbox padding on the right
+        for (int c = 0; c < 3; ++c) {
+            std::fill(r_out + c * plane + out_w, r_out + c * plane + tensor_size.width, pad);
+        }
+    }
+
+    // Letterbox padding at the bottom
+    for (int c = 0; c < 3; ++c) {
+        float* start = dst + c * plane + static_cast<size_t>(out_h) * tensor_size.width;
+        std::fill(start, dst + (c + 1) * plane, pad);
+    }
+    return true;
+}
+
+bool warp_to_tensor(const Frame& frame, const cv::Matx23f& dst_to_src, const cv::Size& out_size,
+                    const TensorNorm& norm, float* dst) {
+    if (out_size.width <= 0 || out_size.height <= 0 || !validate_frame(frame)) return false;
+
+    const bool yuv = is_yuv_format(frame.format);
+    const int cn = packed_channels(frame.format);
+    const bool bgr_order = frame.format == PixelFormat::BGR || frame.format == PixelFormat::BGRA;
+    const int order[3] = {bgr_order ? 2 : 0, 1, bgr_order ? 0 : 2};
+    const YuvCoeffs& coeffs = yuv_coeffs(frame);
+    const FramePlane& p0 = frame.planes[0];
+    const FramePlane& up = frame.planes[1];
+    const FramePlane& vp = frame.planes[2];
+    const int last_x = frame.width - 1;
+    const int last_y = frame.height - 1;
+    const int n = out_size.width;
+    const size_t plane = static_cast<size_t>(n) * out_size.height;
+
+    // Coordinates and blending are computed a row at a time in vector lanes, only the byte taps are
+    // gathered one by one
+    const int channels = yuv ? 1 : 3;
+    WarpScratch& s = warp_scratch();
+    s.x0.resize(n);
+    s.x1.resize(n);
+    s.y0.resize(n);
+    s.y1.resize(n);
+    s.wx.resize(n);
+    s.wy.resize(n);
+    s.taps.resize(4 * static_cast<size_t>(channels) * n);
+    if (yuv) {
+        s.luma.resize(n);
+        s.u.resize(n);
+        s.v.resize(n);
+    }
+    float* taps = s.taps.data();
+
+    for (int y = 0; y < out_size.height; ++y) {
+        warp_row_taps(dst_to_src, y, n, last_x, last_y, s);
+
+        for (int x = 0; x < n; ++x) {
+            const uint8_t* row0 = p0.data + static_cast<size_t>(s.y0[x]) * p0.rowStride;
+            const uint8_t* row1 = p0.data + static_cast<size_t>(s.y1[x]) * p0.rowStride;
+            if (yuv) {
+                taps[x] = row0[s.x0[x]];
+                taps[n + x] = row0[s.x1[x]];
+                taps[2 * n + x] = row1[s.x0[x]];
+                taps[3 * n + x] = row1[s.x1[x]];
+
+                // Nearest 4:2:0 chroma sample
+                int cx = (s.wx[x] >= 0.5f ? s.x1[x] : s.x0[x]) / 2;
+                size_t cy = static_cast<size_t>((s.wy[x] >= 0.5f ? s.y1[x] : s.y0[x]) / 2);
+                s.u[x] = up.data[cy * up.rowStride + cx * up.pixelStride] - 128.0f;
+                s.v[x] = vp.data[cy * vp.rowStride + cx * vp.pixelStride] - 128.0f;
+            } else {
+                const uint8_t* a = row0 + s.x0[x] * cn;
+                const uint8_t* b = row0 + s.x1[x] * cn;
+                const uint8_t* c = row1 + s.x0[x] * cn;
+                const uint8_t* d = row1 + s.x1[x] * cn;
+                for (int ch = 0; ch < 3; ++ch) {
+                    int k = order[ch];
+                    float* t = taps + 4 * ch * static_cast<size_t>(n);
+                    t[x] = a[k];
+                    t[n + x] = b[k];
+                    t[2 * n + x] = c[k];
+                    t[3 * n + x] = d[k];
+                }
+            }
+        }
+
+        float* r_out = dst + static_cast<size_t>(y) * n;
+        if (yuv) {
+            blend_taps(taps, taps + n, taps + 2 * n, taps + 3 * n, s.wx.data(), s.wy.data(), TensorNorm(),
+                       s.luma.data(), n);
+            // The luma row is already interpolated, so blending it with itself only converts it
+            blend_yuv_rows(s.luma.data(), s.luma.data(), 0.0f, s.u.data(), s.v.data(), coeffs, norm,
+                           r_out, r_out + plane, r_out + 2 * plane, n);
+        } else {
+            for (int ch = 0; ch < 3; ++ch) {
+                const float* t = taps + 4 * ch * static_cast<size_t>(n);
+                blend_taps(t, t + n, t + 2 * n, t + 3 * n, s.wx.data(), s.wy.data(), norm, r_out + ch * plane, n);
+            }
+        }
+    }
+    return true;
+}
+
+int select_scores(const float* scores, int count, float threshold, int* indices) {
+    int found = 0;
+    int i = 0;
+#if (CV_SIMD || CV_SIMD_SCALABLE)
+    const int lanes = cv::VTraits<cv::v_float32>::vlanes();
+    const cv::v_float32 vthreshold = cv::vx_setall_f32(threshold);
+    for (; i <= count - lanes; i += lanes) {
+        if (!cv::v_check_any(cv::v_ge(cv::vx_load(scores + i), vthreshold))) continue;
+        for (int k = i; k < i + lanes; ++k) {
+            if (scores[k] >= threshold) indices[found++] = k;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (scores[i] >= threshold) indices[found++] = i;
+    }
+    return found;
+}
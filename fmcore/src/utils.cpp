@@ -11,7 +11,8 @@
             cv::rectangle(debug_img, det.box, cv::Scalar(0, 255, 0), 2);
 
             // Draw landmarks
-            for (const auto& lm : det.landmarks) {
+            for (int j = 0; j < det.landmark_count; ++j) {
+                const auto& lm = det.landmarks[j];
                 cv::circle(debug_img, cv::Point(cvRound(lm.x), cvRound(lm.y)), 3, cv::Scalar(0, 0, 255), -1);
             }
             
@@ -29,7 +30,8 @@
 
         cv::rectangle(debugImage, face.box, cv::Scalar(0, 255, 0), 2);
 
-        for (const auto& lm : face.landmarks) {
+        for (int j = 0; j < face.landmark_count; ++j) {
+            const auto& lm = face.landmarks[j];
             cv::circle(debugImage, cv::Point(cvRound(lm.x), cvRound(lm.y)), 3, cv::Scalar(0, 0, 255), -1);
         }
         
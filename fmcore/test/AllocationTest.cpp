@@ -0,0 +1,163 @@
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+
+#include "FMCore.h"
+#include "face_detection.h"
+#include "json.hpp"
+#include "ort_session.h"
+#include "tensor_kernels.h"
+
+// Counts heap allocations (global operator new) in the steady-state inference loop, split by whether
+// a BoundRun::run is in progress on the allocating thread. Preprocessing kernels, our side of a bound
+// Run, face decoding into a reused result vector and process() into a reused ProcessResult must not
+// allocate outside Run once warmed up; allocations ORT makes inside Run are reported only.
+// Usage: ./fmcore_alloc_test [iterations]
+
+namespace {
+
+std::atomic<size_t> allocations(0);
+std::atomic<size_t> run_allocations(0);
+
+void count_allocation() {
+    if (BoundRun::in_progress() > 0) {
+        ++run_allocations;
+    } else {
+        ++allocations;
+    }
+}
+
+void* counted_alloc(std::size_t size) {
+    count_allocation();
+    if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void* counted_aligned_alloc(std::size_t size, std::align_val_t align) {
+    count_allocation();
+    std::size_t alignment = static_cast<std::size_t>(align);
+    if (void* ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) return ptr;
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return counted_aligned_alloc(size, align); }
+void* operator new[](std::size_t size, std::align_val_t align) { return counted_aligned_alloc(size, align); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+struct AllocationCount {
+    size_t outside_run = 0;
+    size_t inside_run = 0;
+};
+
+// Allocations of all iterations of body after a warm-up call
+template <typename F>
+AllocationCount count_allocations(int iterations, F body) {
+    body();
+    AllocationCount count;
+    count.outside_run = allocations;
+    count.inside_run = run_allocations;
+    for (int i = 0; i < iterations; ++i) body();
+    count.outside_run = allocations - count.outside_run;
+    count.inside_run = run_allocations - count.inside_run;
+    return count;
+}
+
+bool expect_none(const std::string& label, const AllocationCount& count) {
+    const bool ok = count.outside_run == 0;
+    std::cerr << label << "," << count.outside_run << "," << count.inside_run << (ok ? ",ok" : ",FAIL") << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 20;
+    const std::string modelsDir = "../../models";
+
+    std::ifstream configFile("assets/config.json");
+    if (!configFile.is_open()) {
+        std::cerr << "Failed to open config file: assets/config.json" << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << configFile.rdbuf();
+    nlohmann::json config = nlohmann::json::parse(buffer.str());
+
+    cv::Mat image = cv::imread("assets/keanu.png", cv::IMREAD_COLOR);
+    if (image.empty()) {
+        std::cerr << "Failed to load assets/keanu.png" << std::endl;
+        return 1;
+    }
+    Frame frame = makeFrame(image.data, image.cols, image.rows, static_cast<int>(image.step), PixelFormat::BGR);
+    const cv::Rect whole(0, 0, frame.width, frame.height);
+
+    bool ok = true;
+    std::cerr << "stage,allocations,ort_run_allocations,status (" << iterations << " calls)" << std::endl;
+
+    std::vector<float> tensor(3 * 256 * 256);
+    ok &= expect_none("resize_to_tensor", count_allocations(iterations, [&]() {
+        resize_to_tensor(frame, whole, cv::Size(256, 256), cv::Size(256, 256), TensorNorm(), tensor.data());
+    }));
+    const cv::Matx23f shrink(frame.width / 112.0f, 0.0f, 0.0f, 0.0f, frame.height / 112.0f, 0.0f);
+    ok &= expect_none("warp_to_tensor", count_allocations(iterations, [&]() {
+        warp_to_tensor(frame, shrink, cv::Size(112, 112), TensorNorm{127.5f, 1.0f / 127.5f}, tensor.data());
+    }));
+
+    // Detector loop as the wrapper runs it: lease, bind, preprocess into the bound input, Run
+    const std::string detectorPath = modelsDir + "/" + config["face_detector_model"].get<std::string>();
+    ModelSession detector(create_session(detectorPath, OrtSettings()));
+    detector.set_input_shape(0, {1, 3, 256, 256});
+    ok &= expect_none("bound_run_wrapper", count_allocations(iterations, [&]() {
+        ModelSession::Lease run = detector.acquire();
+        run->bind(1);
+        resize_to_tensor(frame, whole, cv::Size(256, 256), cv::Size(256, 256), TensorNorm(), run->input(0));
+        run->run(Ort::RunOptions{nullptr});
+    }));
+
+    // The whole detector with a caller-provided result vector
+    FaceDetectorOptions detectorOptions;
+    detectorOptions.best_face_only = true;
+    FaceDetector faceDetector;
+    if (!faceDetector.init(OrtSettings(), detectorPath, detectorOptions)) {
+        std::cerr << "Face detector initialization failed.\n";
+        return 1;
+    }
+    std::vector<FaceDetectionResult> faces;
+    std::streambuf* logBuffer = std::cout.rdbuf(nullptr);
+    AllocationCount detect = count_allocations(iterations, [&]() {
+        faceDetector.detect_faces(&frame, 1, &faces);
+    });
+    std::cout.rdbuf(logBuffer);
+    ok &= expect_none("detect_faces_reused_result", detect);
+
+    // The whole pipeline into a reused result
+    FMCore core;
+    if (!core.init(buffer.str(), modelsDir)) {
+        std::cerr << "Initialization failed.\n";
+        return 1;
+    }
+    ProcessResult result;
+    std::streambuf* coutBuffer = std::cout.rdbuf(nullptr);
+    AllocationCount process = count_allocations(iterations, [&]() {
+        core.process(frame, PipelineMode::WholePipeline, result);
+    });
+    std::cout.rdbuf(coutBuffer);
+    ok &= expect_none("process_reused_result", process);
+
+    return ok ? 0 : 1;
+}
@@ -3,6 +3,8 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 
 #include "FMCore.h"
 
@@ -88,10 +90,36 @@ int main() {
     std::cout << "[Matching] Cruise image - whole pipeline..." << std::endl;
     process_and_store(core, "assets/cruise.png", PipelineMode::WholePipeline, r3);
 
+    // In-memory frames
+    ProcessResult r4, r5;
+    cv::Mat keanu = cv::imread("assets/keanu.png", cv::IMREAD_COLOR);
+    std::cout << "[Matching] Keanu1 BGR buffer - whole pipeline..." << std::endl;
+    r4 = core.process(keanu.data, keanu.cols, keanu.rows, static_cast<int>(keanu.step), PixelFormat::BGR, PipelineMode::WholePipeline);
+    cv::Mat keanuI420;
+    cv::Mat keanuEven = keanu(cv::Rect(0, 0, keanu.cols & ~1, keanu.rows & ~1));
+    cv::cvtColor(keanuEven, keanuI420, cv::COLOR_BGR2YUV_I420);
+    std::cout << "[Matching] Keanu1 I420 buffer - whole pipeline..." << std::endl;
+    r5 = core.process(keanuI420.data, keanuEven.cols, keanuEven.rows, keanuEven.cols, PixelFormat::I420, PipelineMode::WholePipeline);
+
+    // Batch of frames processed together
+    cv::Mat keanu2 = cv::imread("assets/keanu2.png", cv::IMREAD_COLOR);
+    cv::Mat cruise = cv::imread("assets/cruise.png", cv::IMREAD_COLOR);
+    std::vector<Frame> batch = {
+        makeFrame(keanu.data, keanu.cols, keanu.rows, static_cast<int>(keanu.step), PixelFormat::BGR),
+        makeFrame(keanu2.data, keanu2.cols, keanu2.rows, static_cast<int>(keanu2.step), PixelFormat::BGR),
+        makeFrame(cruise.data, cruise.cols, cruise.rows, static_cast<int>(cruise.step), PixelFormat::BGR)
+    };
+    std::cout << "[Matching] Keanu1, Keanu2, Cruise batch - whole pipeline..." << std::endl;
+    std::vector<ProcessResult> rb = core.processBatch(batch, PipelineMode::WholePipeline);
+
     // Matching
+    match_embeddings("Keanu1 vs Keanu1 BGR buffer", r1.embedding, r4.embedding, core);
+    match_embeddings("Keanu1 vs Keanu1 I420 buffer", r1.embedding, r5.embedding, core);
     match_embeddings("Keanu1 vs Keanu2", r1.embedding, r2.embedding, core);
     match_embeddings("Keanu1 vs Cruise", r1.embedding, r3.embedding, core);
     match_embeddings("Keanu2 vs Cruise", r2.embedding, r3.embedding, core);
+    match_embeddings("Keanu1 vs Keanu2 batch", r1.embedding, rb[1].embedding, core);
+    match_embeddings("Keanu1 vs Cruise batch", r1.embedding, rb[2].embedding, core);
 
     core.reset();
     return 0;
@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/imgcodecs.hpp>
+
+#include "FMCore.h"
+
+// Measures process() throughput when the same FMCore is shared by 1..N threads,
+// then processAsync() throughput from a single submitting thread.
+// Usage: ./fmcore_bench [iterations_per_thread]
+
+double run_threads(FMCore& core, const Frame& frame, int threadCount, int iterations, int& failures) {
+    std::atomic<int> failed(0);
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&]() {
+            for (int i = 0; i < iterations; ++i) {
+                ProcessResult result = core.process(frame, PipelineMode::WholePipeline);
+                if (!result.faceDetected) {
+                    ++failed;
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    failures = failed;
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return (threadCount * iterations) / seconds;
+}
+
+double run_async(FMCore& core, const Frame& frame, int frames, int& failures) {
+    std::vector<std::future<ProcessResult>> pending;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) {
+        pending.push_back(core.processAsync(frame, PipelineMode::WholePipeline));
+    }
+    failures = 0;
+    for (auto& future : pending) {
+        if (!future.get().faceDetected) {
+            ++failures;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return frames / seconds;
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? std::stoi(argv[1]) : 20;
+
+    std::ifstream configFile("assets/config.json");
+    if (!configFile.is_open()) {
+        std::cerr << "Failed to open config file: assets/config.json" << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << configFile.rdbuf();
+
+    FMCore core;
+    if (!core.init(buffer.str(), "../../models")) {
+        std::cerr << "Initialization failed.\n";
+        return 1;
+    }
+
+    cv::Mat image = cv::imread("assets/keanu.png", cv::IMREAD_COLOR);
+    if (image.empty()) {
+        std::cerr << "Failed to load assets/keanu.png" << std::endl;
+        return 1;
+    }
+    Frame frame = makeFrame(image.data, image.cols, image.rows, static_cast<int>(image.step), PixelFormat::BGR);
+
+    // Silence the per-call pipeline logging while measuring
+    std::streambuf* coutBuffer = std::cout.rdbuf(nullptr);
+
+    int failures = 0;
+    run_threads(core, frame, 1, 2, failures); // warm-up
+
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for (unsigned int n = 1; n < cores; n *= 2) threadCounts.push_back(static_cast<int>(n));
+    threadCounts.push_back(static_cast<int>(cores));
+
+    double baseline = 0.0;
+    std::cerr << "threads,frames_per_second,speedup,failures" << std::endl;
+    for (int threads : threadCounts) {
+        double fps = run_threads(core, frame, threads, iterations, failures);
+        if (threads == 1) baseline = fps;
+        std::cerr << threads << "," << fps << "," << fps / baseline << "," << failures << std::endl;
+    }
+
+    double asyncFps = run_async(core, frame, iterations, failures);
+    std::cerr << "async," << asyncFps << "," << asyncFps / baseline << "," << failures << std::endl;
+
+    std::cout.rdbuf(coutBuffer);
+    return 0;
+}
@@ -1,22 +1,6 @@
 import AVFoundation
-import UIKit
 
 
-extension UIImage {
-    func normalized() -> UIImage {
-        if imageOrientation == .up {
-            return self
-        }
-
-        UIGraphicsBeginImageContextWithOptions(size, false, scale)
-        draw(in: CGRect(origin: .zero, size: size))
-        let normalized = UIGraphicsGetImageFromCurrentImageContext()!
-        UIGraphicsEndImageContext()
-
-        return normalized
-    }
-}
-
 extension CameraViewModel: AVCaptureVideoDataOutputSampleBufferDelegate {
     public func captureOutput(_ output: AVCaptureOutput, didOutput sampleBuffer: CMSampleBuffer, from connection: AVCaptureConnection) {
         if !hasStartedStreaming {
@@ -26,13 +10,20 @@ extension CameraViewModel: AVCaptureVideoDataOutputSampleBufferDelegate {
                 self.sessionStartedCallback = nil // only once
             }
         }
+
+        // Hands the next frame to a pending captureFrame, the buffer stays valid for the callback
+        guard let completion = frameCompletion else { return }
+        frameCompletion = nil
+        completion(CMSampleBufferGetImageBuffer(sampleBuffer))
     }
 }
 
-public class CameraViewModel: NSObject, ObservableObject, AVCapturePhotoCaptureDelegate {
+public class CameraViewModel: NSObject, ObservableObject {
     private let session = AVCaptureSession()
-    private let output = AVCapturePhotoOutput()
-    private var captureCompletion: ((URL?) -> Void)?
+    private let videoOutput = AVCaptureVideoDataOutput()
+    private let videoQueue = DispatchQueue(label: "VideoOutputQueue")
+    // Only touched on videoQueue
+    private var frameCompletion: ((CVPixelBuffer?) -> Void)?
     private var hasStartedStreaming = false
     private var sessionStartedCallback: (() -> Void)?
 
@@ -48,18 +39,30 @@ public class CameraViewModel: NSObject, ObservableObject, AVCapturePhotoCaptureD
         guard let device = AVCaptureDevice.default(.builtInWideAngleCamera, for: .video, position: .front),
               let input = try? AVCaptureDeviceInput(device: device),
               session.canAddInput(input),
-              session.canAddOutput(output) else {
+              session.canAddOutput(videoOutput) else {
             return
         }
         
-        let videoOutput = AVCaptureVideoDataOutput()
-        videoOutput.setSampleBufferDelegate(self, queue: DispatchQueue(label: "VideoOutputQueue"))
-        if session.canAddOutput(videoOutput) {
-            session.addOutput(videoOutput)
-        }
+        // Full-range NV12 frames are read in place by processPixelBuffer
+        videoOutput.videoSettings = [
+            kCVPixelBufferPixelFormatTypeKey as String: kCVPixelFormatType_420YpCbCr8BiPlanarFullRange
+        ]
+        videoOutput.alwaysDiscardsLateVideoFrames = true
+        videoOutput.setSampleBufferDelegate(self, queue: videoQueue)
 
         session.addInput(input)
-        session.addOutput(output)
+        session.addOutput(videoOutput)
+
+        // Upright and unmirrored like a photo, processPixelBuffer expects upright buffers
+        if let connection = videoOutput.connection(with: .video) {
+            if connection.isVideoOrientationSupported {
+                connection.videoOrientation = .portrait
+            }
+            if connection.isVideoMirroringSupported {
+                connection.automaticallyAdjustsVideoMirroring = false
+                connection.isVideoMirrored = false
+            }
+        }
         session.commitConfiguration()
     }
 
@@ -89,47 +92,10 @@ public class CameraViewModel: NSObject, ObservableObject, AVCapturePhotoCaptureD
         return session
     }
 
-    public func capturePhoto(completion: @escaping (URL?) -> Void) {
-        captureCompletion = completion
-
-        let settings = AVCapturePhotoSettings()
-        output.capturePhoto(with: settings, delegate: self)
-    }
-
-    public func photoOutput(_ output: AVCapturePhotoOutput,
-                            didFinishProcessingPhoto photo: AVCapturePhoto,
-                            error: Error?) {
-        
-        if let error = error {
-            print("Photo capture error: \(error.localizedDescription)")
-            captureCompletion?(nil)
-            return
-        }
-        
-        guard let imageData = photo.fileDataRepresentation(),
-              let image = UIImage(data: imageData) else {
-            print("Failed to get UIImage from photo data")
-            captureCompletion?(nil)
-            return
-        }
-
-        let normalizedImage = image.normalized()
-
-        guard let pngData = normalizedImage.pngData() else {
-            print("Failed to create PNG data")
-            captureCompletion?(nil)
-            return
-        }
-
-        let filename = UUID().uuidString + ".png"
-        let fileURL = FileManager.default.temporaryDirectory.appendingPathComponent(filename)
-
-        do {
-            try pngData.write(to: fileURL)
-            captureCompletion?(fileURL)
-        } catch {
-            print("Error saving photo: \(error)")
-            captureCompletion?(nil)
+    // Calls completion on the video queue with the next camera frame, upright NV12
+    public func captureFrame(completion: @escaping (CVPixelBuffer?) -> Void) {
+        videoQueue.async {
+            self.frameCompletion = completion
         }
     }
 }
@@ -9,7 +9,8 @@ NS_ASSUME_NONNULL_BEGIN
 @property(nonatomic, assign) BOOL faceDetected;
 @property(nonatomic, assign) BOOL embeddingExtracted;
 @property(nonatomic, assign) float livenessScore;
-@property(nonatomic, strong) NSArray<NSNumber *> *embedding;
+// Contiguous float32 embedding (embedding.length / sizeof(float) values)
+@property(nonatomic, strong) NSData *embedding;
 
 @end
 
@@ -1,4 +1,5 @@
 #import <Foundation/Foundation.h>
+#import <CoreVideo/CoreVideo.h>
 #import "FMProcessResult.h"
 
 NS_ASSUME_NONNULL_BEGIN
@@ -13,9 +14,13 @@ NS_ASSUME_NONNULL_BEGIN
 // Runs the full processing pipeline on the image
 - (FMProcessResult *)processImageAtPath:(NSString *)imagePath skipLiveness:(BOOL)skipLiveness;
 
-// Computes similarity between two embeddings
-- (BOOL)matchEmbedding:(NSArray<NSNumber *> *)embedding1
-         withEmbedding:(NSArray<NSNumber *> *)embedding2;
+// Runs the full processing pipeline on an upright camera buffer without copying it.
+// Supports kCVPixelFormatType_32BGRA and 420YpCbCr8BiPlanar (full or video range).
+- (FMProcessResult *)processPixelBuffer:(CVPixelBufferRef)pixelBuffer skipLiveness:(BOOL)skipLiveness;
+
+// Computes similarity between two float32 embeddings
+- (BOOL)matchEmbedding:(NSData *)embedding1
+         withEmbedding:(NSData *)embedding2;
 
 // Resets the internal engine state
 - (void)reset;
@@ -3,6 +3,21 @@
 
 extern void setDebugSavePath(const std::string&);
 
+static FMProcessResult *wrapResult(ProcessResult& result) {
+    FMProcessResult *wrapped = [[FMProcessResult alloc] init];
+    wrapped.livenessChecked = result.livenessChecked;
+    wrapped.isLive = result.isLive;
+    wrapped.faceDetected = result.faceDetected;
+    wrapped.embeddingExtracted = result.embeddingExtracted;
+    wrapped.livenessScore = result.livenessScore;
+
+    // Hand the embedding storage over to NSData instead of boxing every value
+    auto *embedding = new std::vector<float>(std::move(result.embedding));
+    wrapped.embedding = [[NSData alloc] initWithBytesNoCopy:embedding->data()
+                                                     length:embedding->size() * sizeof(float)
+                                                deallocator:^(void *, NSUInteger) { delete embedding; }];
+    return wrapped;
+}
 
 @implementation FaceMatchBridge {
     FMCore engine;
@@ -28,38 +43,74 @@ extern void setDebugSavePath(const std::string&);
     std::string pathStr = [imagePath UTF8String];
     PipelineMode mode = skipLiveness ? PipelineMode::SkipLiveness : PipelineMode::WholePipeline;
 
-    ProcessResult result = engine.process(pathStr, mode);
-
-    FMProcessResult *wrapped = [[FMProcessResult alloc] init];
-    wrapped.livenessChecked = result.livenessChecked;
-    wrapped.isLive = result.isLive;
-    wrapped.faceDetected = result.faceDetected;
-    wrapped.embeddingExtracted = result.embeddingExtracted;
-    wrapped.livenessScore = result.livenessScore;
+    // Reference photos skip liveness, their face may be small (ID documents)
+    DetectorRange range = skipLiveness ? DetectorRange::Long : DetectorRange::Auto;
 
-    NSMutableArray<NSNumber *> *embeddingArray = [NSMutableArray arrayWithCapacity:result.embedding.size()];
-    for (float val : result.embedding) {
-        [embeddingArray addObject:@(val)];
-    }
-    wrapped.embedding = embeddingArray;
+    ProcessResult result = engine.process(pathStr, mode, range);
 
-    return wrapped;
+    return wrapResult(result);
 }
 
 
-- (BOOL)matchEmbedding:(NSArray<NSNumber *> *)embedding1
-         withEmbedding:(NSArray<NSNumber *> *)embedding2 {
+- (FMProcessResult *)processPixelBuffer:(CVPixelBufferRef)pixelBuffer skipLiveness:(BOOL)skipLiveness {
+    PipelineMode mode = skipLiveness ? PipelineMode::SkipLiveness : PipelineMode::WholePipeline;
+    ProcessResult result;
 
-    std::vector<float> vec1, vec2;
+    if (CVPixelBufferLockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess) {
+        NSLog(@"[FaceMatchBridge] Failed to lock pixel buffer");
+        return wrapResult(result);
+    }
 
-    for (NSNumber *n in embedding1) {
-        vec1.push_back(n.floatValue);
+    // Wrap the locked planes, FMCore reads them in place
+    OSType pixelFormat = CVPixelBufferGetPixelFormatType(pixelBuffer);
+    Frame frame;
+    frame.width = static_cast<int>(CVPixelBufferGetWidth(pixelBuffer));
+    frame.height = static_cast<int>(CVPixelBufferGetHeight(pixelBuffer));
+    bool supported = true;
+
+    switch (pixelFormat) {
+        case kCVPixelFormatType_32BGRA:
+            frame.format = PixelFormat::BGRA;
+            frame.planes[0] = {static_cast<const uint8_t *>(CVPixelBufferGetBaseAddress(pixelBuffer)),
+                               static_cast<int>(CVPixelBufferGetBytesPerRow(pixelBuffer)), 1};
+            break;
+        case kCVPixelFormatType_420YpCbCr8BiPlanarFullRange:
+        case kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange: {
+            const auto *chroma = static_cast<const uint8_t *>(CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 1));
+            int chromaStride = static_cast<int>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 1));
+            frame.format = PixelFormat::NV12;
+            frame.fullRange = pixelFormat == kCVPixelFormatType_420YpCbCr8BiPlanarFullRange;
+            frame.planes[0] = {static_cast<const uint8_t *>(CVPixelBufferGetBaseAddressOfPlane(pixelBuffer, 0)),
+                               static_cast<int>(CVPixelBufferGetBytesPerRowOfPlane(pixelBuffer, 0)), 1};
+            frame.planes[1] = {chroma, chromaStride, 2};
+            frame.planes[2] = {chroma + 1, chromaStride, 2};
+            break;
+        }
+        default:
+            supported = false;
+            break;
     }
-    for (NSNumber *n in embedding2) {
-        vec2.push_back(n.floatValue);
+
+    if (supported) {
+        result = engine.process(frame, mode);
+    } else {
+        NSLog(@"[FaceMatchBridge] Unsupported pixel format: %u", (unsigned int)pixelFormat);
+    }
+
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    return wrapResult(result);
+}
+
+
+- (BOOL)matchEmbedding:(NSData *)embedding1
+         withEmbedding:(NSData *)embedding2 {
+    if (embedding1.length != embedding2.length) {
+        return NO;
     }
 
-    return engine.match(vec1, vec2);
+    return engine.match(static_cast<const float *>(embedding1.bytes),
+                        static_cast<const float *>(embedding2.bytes),
+                        embedding1.length / sizeof(float));
 }
 
 - (void)reset {
@@ -2,12 +2,14 @@ import Foundation
 import SwiftUI
 import AVFoundation
 import UIKit
+import CoreImage
 
 public class FaceMatchSDKImpl: FaceMatchSDK {
     private let cameraVM = CameraViewModel()
     private var previewVC: CameraPreviewViewController?
     private var isInitialized = false
     private let decisor = Decisor(numSamples: 3)
+    private let ciContext = CIContext()
     
     private func dismissCamera() {
         self.cameraVM.stopSession()
@@ -84,15 +86,18 @@ public class FaceMatchSDKImpl: FaceMatchSDK {
         }
 
         func captureLoop() {
-            self.cameraVM.capturePhoto { capturedURL in
-                guard let capturedURL = capturedURL else {
+            self.cameraVM.captureFrame { pixelBuffer in
+                guard let pixelBuffer = pixelBuffer else {
                     print("Capture failed")
-                    self.dismissCamera()
-                    onResult(matchResultErr())
+                    DispatchQueue.main.async {
+                        self.dismissCamera()
+                        onResult(matchResultErr())
+                    }
                     return
                 }
 
-                let capturedResult = FaceMatchBridge.sharedInstance().processImage(atPath: capturedURL.path, skipLiveness: false)
+                // The camera buffer is processed in place, no photo encoding or temporary file
+                let capturedResult = FaceMatchBridge.sharedInstance().processPixelBuffer(pixelBuffer, skipLiveness: false)
                 if (!capturedResult.faceDetected){
                     print("No face detected. Retrying...")
                     captureLoop()
@@ -101,20 +106,25 @@ public class FaceMatchSDKImpl: FaceMatchSDK {
 
                 let isSame = FaceMatchBridge.sharedInstance().matchEmbedding(referenceResult.embedding, withEmbedding: capturedResult.embedding)
 
+                // Only live matching frames can end up in the final result, keep those as PNG
+                let capturedPath = capturedResult.isLive && isSame ? self.saveFrame(pixelBuffer) : nil
+
                 self.decisor.addSample(
                     MatchResult(
                         processed: true,
                         referenceIsValid: true,
                         capturedIsLive: capturedResult.isLive,
                         isSameSubject: isSame,
-                        capturedPath: capturedURL.path
+                        capturedPath: capturedPath
                     )
                 )
 
                 if self.decisor.isReady() {
-                    self.dismissCamera()
                     let final = self.decisor.aggregate()
-                    onResult(final)
+                    DispatchQueue.main.async {
+                        self.dismissCamera()
+                        onResult(final)
+                    }
                 } else {
                     captureLoop()
                 }
@@ -122,6 +132,24 @@ public class FaceMatchSDKImpl: FaceMatchSDK {
         }
     }
 
+    private func saveFrame(_ pixelBuffer: CVPixelBuffer) -> String? {
+        let image = CIImage(cvPixelBuffer: pixelBuffer)
+        guard let cgImage = ciContext.createCGImage(image, from: image.extent),
+              let pngData = UIImage(cgImage: cgImage).pngData() else {
+            print("Failed to create PNG data")
+            return nil
+        }
+
+        let fileURL = FileManager.default.temporaryDirectory.appendingPathComponent(UUID().uuidString + ".png")
+        do {
+            try pngData.write(to: fileURL)
+            return fileURL.path
+        } catch {
+            print("Error saving frame: \(error)")
+            return nil
+        }
+    }
+
     public func reset() {
         FaceMatchBridge.sharedInstance().reset()
         decisor.reset()
@@ -1,4 +1,9 @@
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <opencv2/core.hpp>
@@ -9,6 +14,71 @@ enum class PipelineMode {
     WholePipeline = 2
 };
 
+// Models behind the pipeline stages, see FMCore::init and FMCore::unload
+enum class ModelStage {
+    Detection = 0,
+    Liveness = 1,
+    Embedding = 2
+};
+
+// Face detector a request runs when a short-range model is configured ("face_detector_short_model").
+// Short suits close-up selfie frames, Long reference and ID photos. Auto picks Short while the
+// previous frame's face filled enough of the image and falls back to Long when Short finds nothing.
+// Requests with an explicit range don't affect the Auto selection.
+enum class DetectorRange {
+    Auto = 0,
+    Short = 1,
+    Long = 2
+};
+
+enum class PixelFormat {
+    BGR = 0,
+    RGB = 1,
+    RGBA = 2,
+    BGRA = 3,
+    NV21 = 4,
+    NV12 = 5,
+    I420 = 6
+};
+
+// One plane of a raw pixel buffer. pixelStride is the distance in bytes between two
+// consecutive samples of the plane (1 for planar chroma, 2 for interleaved UV/VU).
+struct FramePlane {
+    const uint8_t* data = nullptr;
+    int rowStride = 0;
+    int pixelStride = 1;
+};
+
+// Non-owning view over a raw pixel buffer, the memory must stay valid during processing.
+// Packed formats (BGR, RGB, RGBA, BGRA) only use planes[0].
+// YUV formats always describe planes[0] = Y, planes[1] = U, planes[2] = V, so semi-planar
+// buffers (NV12/NV21, Android YUV_420_888) are expressed with a chroma pixelStride of 2.
+// YUV samples are BT.601 video range unless fullRange is set (e.g. iOS 420f buffers).
+struct Frame {
+    PixelFormat format = PixelFormat::BGR;
+    int width = 0;
+    int height = 0;
+    FramePlane planes[3];
+    bool fullRange = false;
+};
+
+// Builds a Frame over a single contiguous buffer (chroma planes follow the Y plane)
+Frame makeFrame(const uint8_t* data, int width, int height, int stride, PixelFormat format);
+
+// A model passed to FMCore::init without a path: bytes in memory, or a byte range of an open file
+// (e.g. an uncompressed APK asset from an AssetFileDescriptor) that is mapped read-only while its
+// session is created, so nothing is copied to disk first. Memory must stay valid as long as the
+// FMCore may (re)load the model; file descriptors are duplicated, the caller can close its own.
+struct ModelSource {
+    const void* data = nullptr;
+    int fd = -1;
+    int64_t offset = 0;
+    size_t size = 0;
+};
+
+ModelSource modelFromMemory(const void* data, size_t size);
+ModelSource modelFromFd(int fd, int64_t offset, size_t size);
+
 struct ProcessResult {
     bool livenessChecked = false;
     bool isLive = false;
@@ -18,12 +88,61 @@ struct ProcessResult {
     std::vector<float> embedding;
 };
 
+// Each FMCore instance owns its models and thresholds, several engines can live side by side.
+// process() and match() are thread-safe and may be called concurrently on the same instance.
 class FMCore {
 public:
+    FMCore();
+    ~FMCore();
+    FMCore(FMCore&&) noexcept;
+    FMCore& operator=(FMCore&&) noexcept;
+
+    // Loads every model up front
     bool init(const std::string& configJson, const std::string& modelBasePath);
-    ProcessResult process(const std::string& imagePath, PipelineMode mode);
+    // Only loads the preload models now, the others are loaded by the first request whose mode
+    // needs them, so models a deployment never uses are never read or optimized. A model that fails
+    // to load isn't tried again until the next init.
+    bool init(const std::string& configJson, const std::string& modelBasePath, const std::vector<ModelStage>& preload);
+    // Same, each model file named in the config is taken from models instead of a directory
+    bool init(const std::string& configJson, const std::map<std::string, ModelSource>& models,
+              const std::vector<ModelStage>& preload = {ModelStage::Detection, ModelStage::Liveness,
+                                                        ModelStage::Embedding});
+    // Runs init on a background thread. The FMCore must not be used, moved or destroyed until
+    // the future is ready.
+    std::future<bool> initAsync(const std::string& configJson, const std::string& modelBasePath,
+                                const std::vector<ModelStage>& preload = {ModelStage::Detection, ModelStage::Liveness,
+                                                                          ModelStage::Embedding});
+    // Releases a model's session and memory, the next request that needs it loads it again.
+    // Requests already past the model check may come back without that stage's result.
+    void unload(ModelStage stage);
+    ProcessResult process(const std::string& imagePath, PipelineMode mode, DetectorRange range = DetectorRange::Auto);
+    ProcessResult process(const Frame& frame, PipelineMode mode, DetectorRange range = DetectorRange::Auto);
+    // Same, into result: a ProcessResult reused from call to call keeps its embedding storage, so once
+    // warmed up a call doesn't allocate outside ONNX Runtime (unless "parallel_branches" is set)
+    void process(const Frame& frame, PipelineMode mode, ProcessResult& result, DetectorRange range = DetectorRange::Auto);
+    ProcessResult process(const uint8_t* data, int width, int height, int stride, PixelFormat format, PipelineMode mode,
+                          DetectorRange range = DetectorRange::Auto);
+    // Processes several frames with one batched inference per stage, results are in input order.
+    std::vector<ProcessResult> processBatch(const std::vector<Frame>& frames, PipelineMode mode,
+                                            DetectorRange range = DetectorRange::Auto);
+    // Queues the frame on an internal stage pipeline, so detection, liveness and embedding of
+    // consecutive frames overlap. The frame memory must stay valid until the result is delivered.
+    // Blocks while "async_queue_depth" requests are already waiting.
+    std::future<ProcessResult> processAsync(const Frame& frame, PipelineMode mode, DetectorRange range = DetectorRange::Auto);
+    // Same, the callback runs on a pipeline thread and should return quickly without throwing.
+    void processAsync(const Frame& frame, PipelineMode mode, std::function<void(ProcessResult)> callback,
+                      DetectorRange range = DetectorRange::Auto);
     bool match(const std::vector<float>& embedding1, const std::vector<float>& embedding2);
+    bool match(const float* embedding1, const float* embedding2, size_t size);
+    // Cosine similarity used by match(), without logging, and its threshold test. Split out for
+    // callers that score pinned memory (e.g. a JNI critical section) and must not block meanwhile.
+    float similarity(const float* embedding1, const float* embedding2, size_t size) const;
+    bool isMatch(float similarity) const;
     void reset();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
 };
 
 